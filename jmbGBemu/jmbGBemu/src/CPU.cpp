@@ -211,14 +211,94 @@ CPU::CPU(MMU *mmu, Emulator *emu, HeaderInfo *hi) {
 	PC_ = 0x100;
 	cycles_done_ = 0;
 	halted_ = false;
+	trace_ = NULL;
+#ifdef JMBGB_PROFILE_OPCODES
+	profile_ = NULL;
+	cb_op_ = 0;
+#endif
+#ifdef JMBGB_PROFILE_GUEST
+	guest_profile_ = NULL;
+#endif
 }
 
 CPU::~CPU() { }
 
+void CPU::setTrace(TraceBuffer *trace) {
+	trace_ = trace;
+}
+
+#ifdef JMBGB_PROFILE_OPCODES
+void CPU::setProfile(OpcodeProfile *profile) {
+	profile_ = profile;
+}
+#endif
+
+#ifdef JMBGB_PROFILE_GUEST
+void CPU::setGuestProfile(GuestProfile *profile) {
+	guest_profile_ = profile;
+}
+#endif
+
+void CPU::saveState(StateWriter &w) {
+	w.put8(A_);
+	w.put8(B_);
+	w.put8(C_);
+	w.put8(D_);
+	w.put8(E_);
+	w.put8(F_);
+	w.put8(H_);
+	w.put8(L_);
+	w.put16(SP_);
+	w.put16(PC_);
+	w.putBool(halted_);
+}
+
+void CPU::loadState(StateReader &r) {
+	A_ = r.get8();
+	B_ = r.get8();
+	C_ = r.get8();
+	D_ = r.get8();
+	E_ = r.get8();
+	F_ = r.get8();
+	H_ = r.get8();
+	L_ = r.get8();
+	SP_ = r.get16();
+	PC_ = r.get16();
+	halted_ = r.getBool();
+
+#ifdef JMBGB_PROFILE_GUEST
+	// the calls on the stack we were tracking aren't the ones in the state
+	if (guest_profile_ != NULL)
+		guest_profile_->resetStack();
+#endif
+}
+
+// Push PC_ onto the stack and jump to address, for CALL, RST and interrupts.
+void CPU::call(WORD address, bool interrupt) {
+	SP_ -= 2;
+	mmu_->writeWord(SP_, PC_);
+	PC_ = address;
+
+#ifdef JMBGB_PROFILE_GUEST
+	if (guest_profile_ != NULL)
+		guest_profile_->enter(mmu_->getROMBank(address), address, SP_, interrupt);
+#else
+	(void)interrupt;
+#endif
+}
+
 void CPU::handleInterrupts() {
 	BYTE in_flag;
 	mmu_->readByte(0xFF0F, in_flag);
 
+	// any enabled request ends a HALT, whether or not it's serviced
+	if (halted_ && in_flag != 0x00) {
+		BYTE in_enable;
+		mmu_->readByte(0xFFFF, in_enable);
+		if (in_enable & in_flag & 0x1F)
+			halted_ = false;
+	}
+
 	// are interrupts enabled, and do we have any requests
 	if (mmu_->ime_ && in_flag != 0x00) {
 		BYTE in_enable;
@@ -231,25 +311,19 @@ void CPU::handleInterrupts() {
 			mmu_->ime_ = false;
 			in_flag &= ~(0x01); // clear the interrupt flag we're handling
 			mmu_->writeByte(0xFF0F, in_flag);
-			SP_ -= 2; // push PC_ onto the stack and set it to correct address
-			mmu_->writeWord(SP_, PC_);
-			PC_ = 0x40;
+			call(0x40, true);
 		} else if (in_enable & 0x02 && in_flag & 0x02) {
 			// LCD STAT
 			mmu_->ime_ = false;
 			in_flag &= ~(0x02); // clear the interrupt flag we're handling
 			mmu_->writeByte(0xFF0F, in_flag);
-			SP_ -= 2; // push PC_ onto the stack and set it to correct address
-			mmu_->writeWord(SP_, PC_);
-			PC_ = 0x48;
+			call(0x48, true);
 		} else if (in_enable & 0x04 && in_flag & 0x04) {
 			// Timer
 			mmu_->ime_ = false;
 			in_flag &= ~(0x04); // clear the interrupt flag we're handling
 			mmu_->writeByte(0xFF0F, in_flag);
-			SP_ -= 2; // push PC_ onto the stack and set it to correct address
-			mmu_->writeWord(SP_, PC_);
-			PC_ = 0x50;
+			call(0x50, true);
 		} else if (in_enable & 0x08 && in_flag & 0x08) {
 			// Serial - WON'T USE
 		} else if (in_enable & 0x10 && in_flag & 0x10) {
@@ -257,9 +331,7 @@ void CPU::handleInterrupts() {
 			mmu_->ime_ = false;
 			in_flag &= ~(0x10); // clear the interrupt flag we're handling
 			mmu_->writeByte(0xFF0F, in_flag);
-			SP_ -= 2; // push PC_ onto the stack and set it to correct address
-			mmu_->writeWord(SP_, PC_);
-			PC_ = 0x60;
+			call(0x60, true);
 		}
 	}
 }
@@ -267,14 +339,38 @@ void CPU::handleInterrupts() {
 int CPU::run() {
 	// fetch
 	if (!halted_) {
+		WORD address = PC_;
 		mmu_->readByte(PC_++, curr_op);
 
+		if (trace_ != NULL) {
+			trace_->record(address, mmu_->getROMBank(address), curr_op, mmu_->ime_ ? TRACE_FLAG_IME : 0,
+				(A_ << 8) | F_, (B_ << 8) | C_, (D_ << 8) | E_, (H_ << 8) | L_, SP_);
+		}
+
 		// decode and execute
 		(this->*opcodes_[curr_op])();
 
+#ifdef JMBGB_PROFILE_OPCODES
+		if (profile_ != NULL)
+			profile_->count(mmu_->getROMBank(address), address, curr_op, cb_op_, cycles_done_);
+#endif
+#ifdef JMBGB_PROFILE_GUEST
+		// sampled after the instruction, so where we are and the stack agree
+		// even when it was a CALL or RET
+		if (guest_profile_ != NULL && guest_profile_->addCycles(cycles_done_))
+			guest_profile_->sample(mmu_->getROMBank(PC_), PC_);
+#endif
 		return cycles_done_;
 	} else {
-		return 0;
+		// nothing runs, but the clocks keep going until an interrupt wakes us
+		cycles_done_ = 4;
+
+#ifdef JMBGB_PROFILE_GUEST
+		// idle time shows up as [halt] under whatever was waiting
+		if (guest_profile_ != NULL && guest_profile_->addCycles(cycles_done_))
+			guest_profile_->sampleHalted();
+#endif
+		return cycles_done_;
 	}
 }
 
@@ -2722,9 +2818,7 @@ void CPU::CALL_NZ_pnn(){
 	if (F_ & 0x80) {
 		cycles_done_ = 12;
 	} else {
-		SP_ -= 2;
-		mmu_->writeWord(SP_, PC_);
-		PC_ = address;
+		call(address, false);
 
 		cycles_done_ = 24;
 	}
@@ -2763,10 +2857,7 @@ void CPU::ADD_A_n(){
 }
 
 void CPU::RST_00H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0000;
+	call(0x0000, false);
 
 	cycles_done_ = 16;
 }
@@ -2781,6 +2872,10 @@ void CPU::RET_Z(){
 }
 
 void CPU::RET(){
+#ifdef JMBGB_PROFILE_GUEST
+	if (guest_profile_ != NULL)
+		guest_profile_->leave(SP_);
+#endif
 	mmu_->readWord(SP_, PC_);
 	SP_ += 2;
 
@@ -2803,6 +2898,9 @@ void CPU::JP_Z_pnn(){
 void CPU::PREFIX_CB(){
 	BYTE curr_op;
 	mmu_->readByte(PC_++, curr_op);
+#ifdef JMBGB_PROFILE_OPCODES
+	cb_op_ = curr_op;
+#endif
 
 	// decode and execute
 	(this->*cb_opcodes_[curr_op])();
@@ -2814,9 +2912,7 @@ void CPU::CALL_Z_pnn(){
 	PC_ += 2;
 
 	if (F_ & 0x80) {
-		SP_ -= 2;
-		mmu_->writeWord(SP_, PC_);
-		PC_ = address;
+		call(address, false);
 
 		cycles_done_ = 24;
 	} else {
@@ -2829,9 +2925,7 @@ void CPU::CALL_pnn(){
 	mmu_->readWord(PC_, address);
 	PC_ += 2;
 
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-	PC_ = address;
+	call(address, false);
 
 	cycles_done_ = 24;
 }
@@ -2867,10 +2961,7 @@ void CPU::ADC_A_n(){
 }
 
 void CPU::RST_08H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0008;
+	call(0x0008, false);
 
 	cycles_done_ = 16;
 }
@@ -2918,9 +3009,7 @@ void CPU::CALL_NC_pnn(){
 	if (F_ & 0x10) {
 		cycles_done_ = 12;
 	} else {
-		SP_ -= 2;
-		mmu_->writeWord(SP_, PC_);
-		PC_ = address;
+		call(address, false);
 
 		cycles_done_ = 24;
 	}
@@ -2958,10 +3047,7 @@ void CPU::SUB_n(){
 }
 
 void CPU::RST_10H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0010;
+	call(0x0010, false);
 
 	cycles_done_ = 16;
 }
@@ -3002,9 +3088,7 @@ void CPU::CALL_C_pnn(){
 	PC_ += 2;
 
 	if (F_ & 0x10) {
-		SP_ -= 2;
-		mmu_->writeWord(SP_, PC_);
-		PC_ = address;
+		call(address, false);
 
 		cycles_done_ = 24;
 	} else {
@@ -3043,10 +3127,7 @@ void CPU::SBC_A_n(){
 }
 
 void CPU::RST_18H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0018;
+	call(0x0018, false);
 
 	cycles_done_ = 16;
 }
@@ -3104,10 +3185,7 @@ void CPU::AND_n(){
 }
 
 void CPU::RST_20H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0020;
+	call(0x0020, false);
 
 	cycles_done_ = 16;
 }
@@ -3162,10 +3240,7 @@ void CPU::XOR_n(){
 }
 
 void CPU::RST_28H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0028;
+	call(0x0028, false);
 
 	cycles_done_ = 16;
 }
@@ -3227,10 +3302,7 @@ void CPU::OR_n(){
 }
 
 void CPU::RST_30H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0030;
+	call(0x0030, false);
 
 	cycles_done_ = 16;
 }
@@ -3288,10 +3360,7 @@ void CPU::CP_n(){
 }
 
 void CPU::RST_38H(){
-	SP_ -= 2;
-	mmu_->writeWord(SP_, PC_);
-
-	PC_ = 0x0038;
+	call(0x0038, false);
 
 	cycles_done_ = 16;
 }
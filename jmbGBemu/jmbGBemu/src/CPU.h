@@ -9,6 +9,10 @@
 #include "definitions.h"
 #include "HeaderInfo.h"
 #include "MMU.h"
+#include "SaveState.h"
+#include "OpcodeProfile.h"
+#include "GuestProfile.h"
+#include "TraceBuffer.h"
 
 class CPU {
 public:
@@ -19,6 +23,21 @@ public:
 	int run();
 	void test(); // will hold what i'm currently testing on the CPU
 
+	void saveState(StateWriter &w);
+	void loadState(StateReader &r);
+
+	// record every instruction run into trace (NULL stops recording)
+	void setTrace(TraceBuffer *trace);
+
+#ifdef JMBGB_PROFILE_OPCODES
+	// count every instruction run into profile (NULL stops counting)
+	void setProfile(OpcodeProfile *profile);
+#endif
+#ifdef JMBGB_PROFILE_GUEST
+	// report calls, returns and cycles to profile (NULL stops it)
+	void setGuestProfile(GuestProfile *profile);
+#endif
+
 private:
 	HeaderInfo *hi_;
 	MMU *mmu_; // memory object
@@ -37,6 +56,18 @@ private:
 	// we will not process anything except interrupts if halted.
 	bool halted_;
 
+	TraceBuffer *trace_;
+
+#ifdef JMBGB_PROFILE_OPCODES
+	OpcodeProfile *profile_;
+	BYTE cb_op_; // the CB opcode PREFIX_CB() last ran
+#endif
+#ifdef JMBGB_PROFILE_GUEST
+	GuestProfile *guest_profile_;
+#endif
+
+	void call(WORD address, bool interrupt);
+
 	// Opcode functions.
 	void XX(); // no opcode assigned
 	
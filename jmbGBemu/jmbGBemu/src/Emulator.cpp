@@ -4,9 +4,21 @@
 // running the emulation, and cleaning up the simulation once finished.
 
 #include "Emulator.h"
+#include "Log.h"
+
+#include <fstream>
 
 // Take filename of ROM into emulator and begin initialization
 Emulator::Emulator() {
+	cpu_ = NULL;
+	mmu_ = NULL;
+	hi_ = NULL;
+	export_ = NULL;
+	profile_ = NULL;
+	guest_profile_ = NULL;
+	heatmap_ = NULL;
+	trace_ = NULL;
+	total_clocks_ = 0;
 }
 
 // Destructor of emulator. Call shutdown
@@ -14,44 +26,52 @@ Emulator::~Emulator() {
     shutdown();
 }
 
-// Runs emulation, allowing systems to work together
-void Emulator::run() {
-	int cpu_cycle_complete_; // CPU will return number of cycles just run
-
-	// SOME TEST STUFF
-	//mmu_->test();
-	//cpu_->test();
-
-	
-	// our emulation loop
-	start_ticks_ = SDL_GetTicks();
-	while (running_) {
-		// handle input
-		handleInput();
-
-		// run CPU and timings
-		cpu_->handleInterrupts();
-		cpu_cycle_complete_ = cpu_->run();
-		updateClocks(cpu_cycle_complete_);
-	}
-}
-
 // Handles cleanup of emulators systems
 void Emulator::shutdown() {
+	if (pacing_stats_)
+		pacer_.printStats();
+
+	if (profile_ != NULL)
+		profile_->write(profile_filename_);
+	delete profile_;
+	if (guest_profile_ != NULL)
+		guest_profile_->write(guest_profile_filename_);
+	delete guest_profile_;
+	if (heatmap_ != NULL) {
+		heatmap_->writeCSV(heatmap_name_ + ".csv");
+		heatmap_->writePNG(heatmap_name_ + ".png");
+	}
+	delete heatmap_;
+	delete trace_;
+	delete export_;
 	delete cpu_;
 	delete mmu_;
 	delete hi_;
 }
 
 // Initializes the emulator
-void Emulator::initialize(std::string filename) {
-	screen = SDL_SetVideoMode(160, 144, 32, SDL_SWSURFACE);
-
+void Emulator::initialize(std::string filename, bool battery_saves) {
     filename_ = filename;
 	hi_ = new HeaderInfo();
-	mmu_ = new MMU(filename_, hi_, this);
+	total_clocks_ = 0;
+	mmu_ = new MMU(filename_, hi_, this, battery_saves);
 	cpu_ = new CPU(mmu_, this, hi_);
 
+	initSettings();
+}
+
+void Emulator::initialize(std::shared_ptr<const RomImage> rom) {
+	filename_ = rom->getFilename();
+	hi_ = new HeaderInfo();
+	total_clocks_ = 0;
+	mmu_ = new MMU(rom, hi_, this);
+	cpu_ = new CPU(mmu_, this, hi_);
+
+	initSettings();
+}
+
+// Power-on timing state and default settings, shared by initialize() and fork().
+void Emulator::initSettings() {
 	running_ = true;
 	current_clocks_ = 0;
 	div_clocks_ = 0;
@@ -65,7 +85,133 @@ void Emulator::initialize(std::string filename) {
 	timer_mode_clocks_[2] = 64;
 	timer_mode_clocks_[3] = 256;
 
-	start_ticks_ = 0;
+	speed_ = 1.0;
+	turbo_speed_ = SPEED_UNCAPPED;
+	turbo_ = false;
+	pacing_stats_ = false;
+	frames_since_stats_ = 0;
+	frames_since_save_flush_ = 0;
+	pacer_.reset();
+
+	rewind_interval_ = 0;
+	frames_since_rewind_ = 0;
+	rewinding_ = false;
+	frame_done_ = false;
+
+	frame_count_ = 0;
+	buttons_ = 0;
+	input_source_ = NULL;
+	exit_at_input_end_ = false;
+}
+
+// Make a headless copy of this emulator at its current state. The copy
+// shares the ROM image, gets its own copy of everything else (about 25 KB
+// plus cartridge RAM, carried over as a save state) and runs uncapped. It's
+// meant to be driven with runFrame()/setButton(), e.g. to try out different
+// inputs from the same point. The caller owns the copy.
+//
+// The copy is made up front rather than page by page on write, so the cost
+// grows with cartridge RAM: about 8 us with 8 KB and 100 us with 128 KB.
+// Nothing in this is changed, so forking the same emulator from several
+// threads at once is fine as long as none of them is running it.
+Emulator *Emulator::fork() const {
+	Emulator *child = new Emulator();
+	child->filename_ = filename_;
+	child->hi_ = new HeaderInfo(*hi_);
+	child->total_clocks_ = total_clocks_;
+	child->mmu_ = new MMU(*mmu_, child->hi_, child);
+	child->cpu_ = new CPU(child->mmu_, child, child->hi_);
+	child->initSettings();
+	child->speed_ = SPEED_UNCAPPED;
+	child->buttons_ = buttons_;
+
+	// a state we just made can't be damaged, so the child doesn't need to
+	// keep its own to go back to the way loadState() does
+	std::vector<BYTE> state;
+	saveState(state);
+	StateReader r(&state[0], state.size());
+	child->readStateHeader(r);
+	child->readState(r);
+	return child;
+}
+
+// Run until the end of the current frame.
+void Emulator::runFrame() {
+	applyInput();
+
+	frame_done_ = false;
+	while (running_ && !frame_done_) {
+		cpu_->handleInterrupts();
+		updateClocks(cpu_->run());
+	}
+}
+
+// Takes effect from the next frame.
+void Emulator::setButton(Button b, bool pressed) {
+	if (pressed)
+		buttons_ |= buttonBit(b);
+	else
+		buttons_ &= ~buttonBit(b);
+}
+
+void Emulator::setButtons(BYTE buttons) {
+	buttons_ = buttons;
+}
+
+// Not owned. NULL goes back to setButton().
+void Emulator::setInputSource(InputSource *source) {
+	input_source_ = source;
+}
+
+void Emulator::setExitAtInputEnd(bool b) {
+	exit_at_input_end_ = b;
+}
+
+// A movie is the input from power on, so it can't start from a loaded state.
+bool Emulator::recordMovie(std::string filename) {
+	if (frame_count_ != 0) {
+		EMULOG_ERROR("Movies start at power on, can't record %s from frame %u.", filename, frame_count_);
+		return false;
+	}
+	if (mmu_->hasSaveFile())
+		EMULOG_WARNING("The movie won't include the game's save file, it plays back the same only with this .sav.");
+
+	return recorder_.open(filename, hi_->game_name_);
+}
+
+bool Emulator::playMovie(std::string filename) {
+	if (!movie_.load(filename, hi_->game_name_))
+		return false;
+
+	setInputSource(&movie_);
+	return true;
+}
+
+uint64_t Emulator::getFrameCount() {
+	return frame_count_;
+}
+
+// Decide the buttons for the frame about to run, log them if recording, and
+// hand them to the joypad.
+void Emulator::applyInput() {
+	BYTE buttons = buttons_;
+	if (input_source_ != NULL) {
+		buttons = input_source_->getButtons(frame_count_);
+
+		if (input_source_->isFinished()) {
+			EMULOG_INFO("Input finished at frame %u", frame_count_);
+			input_source_ = NULL;
+			if (exit_at_input_end_)
+				running_ = false;
+		}
+	}
+
+	recorder_.record(frame_count_, buttons);
+	mmu_->setButtons(buttons);
+}
+
+bool Emulator::isRunning() {
+	return running_;
 }
 
 void Emulator::setRunning(bool b) {
@@ -73,9 +219,12 @@ void Emulator::setRunning(bool b) {
 }
 
 void Emulator::updateClocks(int cycles) {
+	total_clocks_ += cycles;
 	current_clocks_ += cycles;
 	clocks_until_next_mode_ -= cycles;
 
+	mmu_->updateDMA(cycles);
+
 	div_clocks_ += cycles;
 	if (div_clocks_ >= 256) {
 		mmu_->updateDiv();
@@ -92,46 +241,246 @@ void Emulator::updateClocks(int cycles) {
 	}
 
 	// Here we set the different modes for the LCDC, and figure out our frame clocks, etc.
+	// Mode lengths are added on to whatever is left over so that instructions running
+	// past a mode boundary don't push the rest of the frame out of line.
 	if (clocks_until_next_mode_ <= 0) {
 		if (current_clocks_ < 65664) {
 			if (current_mode_ == MODE_0) {
 				current_mode_ = MODE_2;
 				mmu_->updateLY();
-				clocks_until_next_mode_ = CLOCKS_MODE_2;
+				clocks_until_next_mode_ += CLOCKS_MODE_2;
 				mmu_->setLCDCMode(MODE_2);
 			} else if (current_mode_ == MODE_2) {
 				current_mode_ = MODE_3;
-				clocks_until_next_mode_ = CLOCKS_MODE_3;
+				clocks_until_next_mode_ += CLOCKS_MODE_3;
 				mmu_->setLCDCMode(MODE_3);
 			} else if (current_mode_ == MODE_3) {
+				// pixel transfer is done, draw the line with the registers as they are now
+				mmu_->renderScanline();
+
 				current_mode_ = MODE_0;
-				clocks_until_next_mode_ = CLOCKS_MODE_0;
+				clocks_until_next_mode_ += CLOCKS_MODE_0;
 				mmu_->setLCDCMode(MODE_0);
 			}
-		} else if (current_clocks_ < 70224) { 
-			// we have entered V-Blank
-			current_mode_ = MODE_1;
-			clocks_until_next_mode_ = CLOCKS_MODE_1;
-			mmu_->setLCDCMode(MODE_1);
+		} else if (current_clocks_ < CLOCKS_PER_FRAME) {
+			// V-Blank, LY keeps counting through lines 144-153
+			if (current_mode_ != MODE_1) {
+				current_mode_ = MODE_1;
+				mmu_->setLCDCMode(MODE_1);
+			}
+			mmu_->updateLY();
+			clocks_until_next_mode_ += CLOCKS_PER_LINE;
 		} else { 
 			// we're out of V-Blank and restarting the cycle,
 			// this is the end of frame so we need to spin if we have any time
 			// left
-			current_clocks_ = 0;
+			current_clocks_ -= CLOCKS_PER_FRAME;
 			current_mode_ = MODE_2;
-			clocks_until_next_mode_ = CLOCKS_MODE_2;
+			clocks_until_next_mode_ += CLOCKS_MODE_2;
 			mmu_->setLCDCMode(MODE_2);
 			mmu_->updateLY();
 
-			// TO DO: we're going to draw here
-			mmu_->renderScreen();
+			updateRewind();
+			++frame_count_;
+			frame_done_ = true;
+			if (export_ != NULL)
+				publishFrame();
+
+			// let the OS start writing the save out now and then so a crash
+			// doesn't lose much, the final flush happens when the MMU goes away
+			if (++frames_since_save_flush_ >= SAVE_FLUSH_FRAMES) {
+				mmu_->flushSaveFile(false);
+				frames_since_save_flush_ = 0;
+			}
 
 			spinUntilNextFrame();
-			start_ticks_ = SDL_GetTicks();
 		}
 	}
 }
 
+uint64_t Emulator::getTotalClocks() {
+	return total_clocks_;
+}
+
+void Emulator::catchUpClock() {
+	mmu_->catchUpClock();
+}
+
+// The state starts with a header naming the format and the game, then each
+// part writes its own fields: emulator clocks, CPU, then MMU (which includes
+// the cartridge).
+void Emulator::saveState(std::vector<BYTE> &out) const {
+	StateWriter w(out);
+
+	w.put32(STATE_MAGIC);
+	w.put32(STATE_VERSION);
+	w.putBytes((const BYTE*)hi_->game_name_, sizeof(hi_->game_name_));
+	w.put8(hi_->cartridge_type_);
+	w.put8(hi_->rom_size_);
+	w.put8(hi_->ram_size_);
+
+	w.put32((uint32_t)current_clocks_);
+	w.put64(total_clocks_);
+	w.put64(frame_count_);
+	w.put32((uint32_t)div_clocks_);
+	w.put32((uint32_t)timer_clocks_);
+	w.put32((uint32_t)clocks_until_next_mode_);
+	w.put8((BYTE)current_mode_);
+	w.put8((BYTE)timer_mode_);
+	w.putBool(timer_running_);
+
+	cpu_->saveState(w);
+	mmu_->saveState(w);
+}
+
+bool Emulator::loadState(const BYTE *data, size_t size) {
+	StateReader r(data, size);
+	if (!readStateHeader(r))
+		return false;
+
+	// keep what we have, so a state that turns out to be cut short or
+	// otherwise broken doesn't leave the machine half loaded
+	std::vector<BYTE> previous;
+	saveState(previous);
+
+	if (!readState(r)) {
+		EMULOG_ERROR("Save state is damaged, not loaded.");
+		StateReader back(&previous[0], previous.size());
+		readStateHeader(back);
+		readState(back);
+		return false;
+	}
+
+	// frames would go back in time, which a movie can't hold. Loading a state
+	// and rewinding both come through here.
+	if (recorder_.isOpen()) {
+		EMULOG_WARNING("A state was loaded, movie recording stopped at frame %u.", frame_count_);
+		recorder_.close();
+	}
+
+	return true;
+}
+
+// Check a state's header is one we can load, for this game.
+bool Emulator::readStateHeader(StateReader &r) {
+	if (r.get32() != STATE_MAGIC) {
+		EMULOG_ERROR("Not a save state.");
+		return false;
+	}
+	uint32_t version = r.get32();
+	if (version != STATE_VERSION) {
+		EMULOG_ERROR("Save state version %u isn't supported (expected %u).", version, STATE_VERSION);
+		return false;
+	}
+
+	char game_name[16];
+	r.getBytes((BYTE*)game_name, sizeof(game_name));
+	BYTE cartridge_type = r.get8();
+	BYTE rom_size = r.get8();
+	BYTE ram_size = r.get8();
+	if (memcmp(game_name, hi_->game_name_, sizeof(game_name)) != 0 ||
+		cartridge_type != hi_->cartridge_type_ || rom_size != hi_->rom_size_ ||
+		ram_size != hi_->ram_size_) {
+		EMULOG_ERROR("Save state is for a different game.");
+		return false;
+	}
+	return true;
+}
+
+// Everything after the header. Returns false if the state was damaged, in
+// which case the machine is left half loaded.
+bool Emulator::readState(StateReader &r) {
+	current_clocks_ = (int)r.get32();
+	total_clocks_ = r.get64();
+	frame_count_ = r.get64();
+	div_clocks_ = (int)r.get32();
+	timer_clocks_ = (int)r.get32();
+	clocks_until_next_mode_ = (int)r.get32();
+	current_mode_ = Mode(r.get8());
+	timer_mode_ = Mode(r.get8());
+	timer_running_ = r.getBool();
+
+	cpu_->loadState(r);
+	return mmu_->loadState(r) && !r.failed() && r.remaining() == 0;
+}
+
+bool Emulator::saveStateFile(std::string filename) {
+	saveState(state_buffer_);
+
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (file.is_open())
+		file.write((const char*)&state_buffer_[0], state_buffer_.size());
+	if (!file.is_open() || !file.good()) {
+		EMULOG_ERROR("Couldn't write save state %s", filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool Emulator::loadStateFile(std::string filename) {
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't open save state %s", filename);
+		return false;
+	}
+
+	std::streamoff size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	state_buffer_.resize((size_t)size);
+	if (size <= 0 || !file.read((char*)&state_buffer_[0], size)) {
+		EMULOG_ERROR("Couldn't read save state %s", filename);
+		return false;
+	}
+
+	return loadState(&state_buffer_[0], state_buffer_.size());
+}
+
+void Emulator::setRewind(int interval, size_t capacity) {
+	rewind_interval_ = interval > 0 ? interval : 0;
+	rewind_.setCapacity(rewind_interval_ > 0 ? capacity : 0);
+	frames_since_rewind_ = 0;
+}
+
+void Emulator::setRewinding(bool b) {
+	rewinding_ = b;
+}
+
+// Called at the end of every frame: either step back a snapshot while rewind
+// is held, or take one when it's due.
+void Emulator::updateRewind() {
+	if (rewind_interval_ == 0)
+		return;
+
+	if (rewinding_) {
+		if (rewind_.pop(state_buffer_))
+			loadState(&state_buffer_[0], state_buffer_.size());
+		frames_since_rewind_ = 0;
+	} else if (++frames_since_rewind_ >= rewind_interval_) {
+		saveState(state_buffer_);
+		rewind_.push(state_buffer_);
+		frames_since_rewind_ = 0;
+	}
+}
+
+// <rom name>.state, next to the ROM
+std::string Emulator::getBaseFilename() {
+	std::string name = filename_;
+	size_t dot = name.find_last_of('.');
+	size_t slash = name.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		name.erase(dot);
+	return name;
+}
+
+std::string Emulator::getStateFilename() {
+	return getBaseFilename() + ".state";
+}
+
+std::string Emulator::getTraceFilename() {
+	return getBaseFilename() + ".trace";
+}
+
 void Emulator::setTimerRunning(bool b) {
 	timer_running_ = b;
 }
@@ -140,74 +489,146 @@ void Emulator::setTimerMode(BYTE b) {
 	timer_mode_ = Mode(b);
 }
 
-SDL_Surface *Emulator::getScreen() {
-	return screen;
+void Emulator::setSpeed(double multiplier) {
+	speed_ = multiplier < 0.0 ? SPEED_UNCAPPED : multiplier;
 }
 
-void Emulator::handleInput() {
-	while (SDL_PollEvent(&evnt)) {
-		if (evnt.type == SDL_KEYDOWN) {
-			if (evnt.key.keysym.sym == SDLK_RETURN) {
-				mmu_->setButtonPressed(BUTTON_START);
-			}
-			if (evnt.key.keysym.sym == SDLK_RSHIFT) {
-				mmu_->setButtonPressed(BUTTON_SELECT);
-			}
-			if (evnt.key.keysym.sym == SDLK_a) {
-				mmu_->setButtonPressed(BUTTON_A);
-			}
-			if (evnt.key.keysym.sym == SDLK_s) {
-				mmu_->setButtonPressed(BUTTON_B);
-			}
-			if (evnt.key.keysym.sym == SDLK_RIGHT) {
-				mmu_->setButtonPressed(BUTTON_RIGHT);
-			}
-			if (evnt.key.keysym.sym == SDLK_LEFT) {
-				mmu_->setButtonPressed(BUTTON_LEFT);
-			}
-			if (evnt.key.keysym.sym == SDLK_UP) {
-				mmu_->setButtonPressed(BUTTON_UP);
-			}
-			if (evnt.key.keysym.sym == SDLK_DOWN) {
-				mmu_->setButtonPressed(BUTTON_DOWN);
-			}
-			if (evnt.key.keysym.sym == SDLK_ESCAPE) {
-				running_ = false;
-			}
-		} else if (evnt.type == SDL_KEYUP) {
-			if (evnt.key.keysym.sym == SDLK_RETURN) {
-				mmu_->setButtonReleased(BUTTON_START);
-			}
-			if (evnt.key.keysym.sym == SDLK_RSHIFT) {
-				mmu_->setButtonReleased(BUTTON_SELECT);
-			}
-			if (evnt.key.keysym.sym == SDLK_a) {
-				mmu_->setButtonReleased(BUTTON_A);
-			}
-			if (evnt.key.keysym.sym == SDLK_s) {
-				mmu_->setButtonReleased(BUTTON_B);
-			}
-			if (evnt.key.keysym.sym == SDLK_RIGHT) {
-				mmu_->setButtonReleased(BUTTON_RIGHT);
-			}
-			if (evnt.key.keysym.sym == SDLK_LEFT) {
-				mmu_->setButtonReleased(BUTTON_LEFT);
-			}
-			if (evnt.key.keysym.sym == SDLK_UP) {
-				mmu_->setButtonReleased(BUTTON_UP);
-			}
-			if (evnt.key.keysym.sym == SDLK_DOWN) {
-				mmu_->setButtonReleased(BUTTON_DOWN);
-			} 
-		} else if (evnt.type == SDL_QUIT) {
-			running_ = false;
-		}
+void Emulator::setTurboSpeed(double multiplier) {
+	turbo_speed_ = multiplier < 0.0 ? SPEED_UNCAPPED : multiplier;
+}
+
+void Emulator::setTurbo(bool b) {
+	turbo_ = b;
+}
+
+// Returns the speed multiplier currently in effect, taking turbo into account.
+double Emulator::getSpeed() {
+	return turbo_ ? turbo_speed_ : speed_;
+}
+
+void Emulator::setPacingStats(bool b) {
+	pacing_stats_ = b;
+}
+
+const BYTE *Emulator::getFrameBuffer() {
+	return mmu_->getFrameBuffer();
+}
+
+bool Emulator::exportFrames(std::string name, int num_slots) {
+	if (export_ == NULL)
+		export_ = new FrameExport();
+
+	if (!export_->create(name, num_slots)) {
+		EMULOG_ERROR("Couldn't create shared memory %s", name);
+		delete export_;
+		export_ = NULL;
+		return false;
 	}
+
+	return true;
+}
+
+#if !defined(JMBGB_PROFILE_OPCODES) || !defined(JMBGB_PROFILE_GUEST) || !defined(JMBGB_MEMORY_HEATMAP)
+// What the optional tools below do when they were left out of the build.
+// output is the file that won't be written.
+static bool notBuiltIn(const char *tool, const char *define, const std::string &output) {
+	EMULOG_ERROR("%s isn't built in, rebuild with %s defined. Not writing %s.", tool, define, output);
+	return false;
+}
+#endif
+
+bool Emulator::profileOpcodes(std::string filename) {
+#ifdef JMBGB_PROFILE_OPCODES
+	if (profile_ == NULL)
+		profile_ = new OpcodeProfile();
+	profile_filename_ = filename;
+	cpu_->setProfile(profile_);
+	return true;
+#else
+	return notBuiltIn("Opcode profiling", "JMBGB_PROFILE_OPCODES", filename);
+#endif
+}
+
+bool Emulator::profileGuest(std::string filename, int interval, std::string sym_filename) {
+#ifdef JMBGB_PROFILE_GUEST
+	delete guest_profile_;
+	guest_profile_ = new GuestProfile(interval);
+	guest_profile_filename_ = filename;
+	if (!sym_filename.empty() && !guest_profile_->loadSymbols(sym_filename))
+		EMULOG_WARNING("Couldn't read symbols from %s, using addresses.", sym_filename);
+	cpu_->setGuestProfile(guest_profile_);
+	return true;
+#else
+	(void)interval;
+	(void)sym_filename;
+	return notBuiltIn("Guest profiling", "JMBGB_PROFILE_GUEST", filename);
+#endif
 }
 
+bool Emulator::recordHeatmap(std::string name) {
+#ifdef JMBGB_MEMORY_HEATMAP
+	if (heatmap_ == NULL)
+		heatmap_ = new MemoryHeatmap();
+	heatmap_name_ = name;
+	mmu_->setHeatmap(heatmap_);
+	return true;
+#else
+	return notBuiltIn("Memory heatmap recording", "JMBGB_MEMORY_HEATMAP", name + ".csv/.png");
+#endif
+}
+
+void Emulator::setTrace(uint32_t num_records, std::string crash_filename) {
+	cpu_->setTrace(NULL);
+	delete trace_;
+	trace_ = NULL;
+	if (num_records == 0)
+		return;
+
+	trace_ = new TraceBuffer(num_records, &total_clocks_);
+	if (!crash_filename.empty())
+		trace_->dumpOnCrash(crash_filename);
+	cpu_->setTrace(trace_);
+}
+
+bool Emulator::dumpTrace(std::string filename) {
+	if (trace_ == NULL) {
+		EMULOG_ERROR("Tracing isn't on, nothing to write to %s", filename);
+		return false;
+	}
+	return trace_->write(filename);
+}
+
+void Emulator::publishFrame() {
+	ExportSlot *slot = export_->beginPublish(frame_count_);
+	memcpy(slot->screen, mmu_->getFrameBuffer(), sizeof(slot->screen));
+	mmu_->copyRAM(slot->work_ram, slot->high_ram);
+	export_->endPublish();
+}
+
+void Emulator::setFrameBuffer(BYTE *buffer) {
+	mmu_->setFrameBuffer(buffer);
+}
+
+void Emulator::setFrame(const BYTE *frame) {
+	mmu_->setFrame(frame);
+}
+
+BYTE Emulator::peekMemory(WORD address) {
+	return mmu_->peekByte(address);
+}
+
+void Emulator::pokeMemory(WORD address, BYTE val) {
+	mmu_->writeByte(address, val);
+}
+
+// Wait out whatever is left of this frame at the current speed.
 void Emulator::spinUntilNextFrame() {
-	uint32_t x = SDL_GetTicks() - start_ticks_;
-	if (x < 1000 / 60) {
-		SDL_Delay((1000/60) - x);
+	double speed = getSpeed();
+	pacer_.waitForNextFrame(speed > SPEED_UNCAPPED ? FRAME_RATE_EXACT * speed : 0.0);
+
+	// report roughly every 10 seconds of emulated time
+	if (pacing_stats_ && ++frames_since_stats_ >= 600) {
+		pacer_.printStats();
+		frames_since_stats_ = 0;
 	}
-}
\ No newline at end of file
+}
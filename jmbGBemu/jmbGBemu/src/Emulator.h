@@ -2,34 +2,135 @@
 // Author: Jason Blanchard
 // Define Emulator class, which will be in charge of setting up all Game Boy systems,
 // running the emulation, and cleaning up the simulation once finished.
+// The emulator has no window or keyboard of its own; a frontend (see
+// Frontend.h, or the C API in jmbgb.h) runs it a frame at a time, feeds it
+// buttons and shows getFrameBuffer().
 
 #ifndef _EMULATOR_H
 #define _EMULATOR_H
 
 #include <string>
-#include <SDL.h>
+#include <vector>
+#include <memory>
 
 #include "definitions.h"
 #include "HeaderInfo.h"
 #include "CPU.h"
 #include "MMU.h"
+#include "FramePacer.h"
+#include "SaveState.h"
+#include "RewindBuffer.h"
+#include "InputSource.h"
+#include "Movie.h"
+#include "FrameExport.h"
+#include "OpcodeProfile.h"
+#include "GuestProfile.h"
+#include "TraceBuffer.h"
+#include "MemoryHeatmap.h"
 
 class Emulator {
 public:
     Emulator();
     ~Emulator();
 
-    void initialize(std::string filename);
-    void run();
+    // battery_saves = false keeps cartridge RAM in memory only (no .sav file)
+    void initialize(std::string filename, bool battery_saves = true);
+	// run a ROM image that's already in memory, without a save file
+	void initialize(std::shared_ptr<const RomImage> rom);
     void shutdown();
 
+	// headless copy at the current state, see Emulator.cpp
+	Emulator *fork() const;
+	void runFrame();
+	void setButton(Button b, bool pressed);
+	// all eight buttons at once, bit n for Button n (see buttonBit())
+	void setButtons(BYTE buttons);
+
+	// Joypad input comes from setButton()/setButtons() unless an input source
+	// is set, and is fixed for each frame when it starts. A source that runs
+	// out hands back to setButton(), or stops the emulator.
+	void setInputSource(InputSource *source);
+	void setExitAtInputEnd(bool b);
+	bool recordMovie(std::string filename);
+	bool playMovie(std::string filename);
+	uint64_t getFrameCount();
+
+	// false once the emulator has been told to stop (or its input ran out)
+	bool isRunning();
 	void setRunning(bool b);
 	void updateClocks(int cycles);
 
+	// Emulated clocks since power on. Never wraps in practice and only
+	// depends on what has been emulated, not on the host.
+	uint64_t getTotalClocks();
+
+	// Move the cartridge clock forward by the real time since the last save.
+	void catchUpClock();
+
+	// Snapshot the whole machine into out (reusing its memory), or restore
+	// one. A state that doesn't fit this ROM is rejected and nothing changes.
+	void saveState(std::vector<BYTE> &out) const;
+	bool loadState(const BYTE *data, size_t size);
+	bool saveStateFile(std::string filename);
+	bool loadStateFile(std::string filename);
+	// <rom name>.state, next to the ROM, for quick save and load
+	std::string getStateFilename();
+
+	// Keep a snapshot every interval frames (0 turns rewind off) in up to
+	// capacity bytes. While rewinding, each frame steps back one snapshot.
+	void setRewind(int interval, size_t capacity);
+	void setRewinding(bool b);
+
 	void setTimerRunning(bool b);
 	void setTimerMode(BYTE b);
 
-	SDL_Surface *getScreen();
+	// Speed multipliers relative to real hardware (1.0 = 59.73 Hz). SPEED_UNCAPPED
+	// disables pacing. Turbo speed is used instead while turbo is on.
+	void setSpeed(double multiplier);
+	void setTurboSpeed(double multiplier);
+	void setTurbo(bool b);
+	double getSpeed();
+
+	// print frame time percentiles and drift periodically and at shutdown
+	void setPacingStats(bool b);
+
+	// current frame as 160x144 shade numbers
+	const BYTE *getFrameBuffer();
+	// draw frames straight into buffer instead, see MMU::setFrameBuffer()
+	void setFrameBuffer(BYTE *buffer);
+	void setFrame(const BYTE *frame);
+
+	// Publish every finished frame, with WRAM and HRAM, to other processes
+	// through a ring of num_slots frames in shared memory (see
+	// FrameExport.h). Fails if the shared memory can't be made.
+	bool exportFrames(std::string name, int num_slots);
+
+	// Count the instructions run from now on and write them to filename (CSV,
+	// or JSON if it ends in .json) at shutdown. Only available when built
+	// with JMBGB_PROFILE_OPCODES, see OpcodeProfile.h.
+	bool profileOpcodes(std::string filename);
+	// Sample the game's call stack every interval cycles and write it to
+	// filename as folded stacks at shutdown, naming functions from
+	// sym_filename if it's there. Only available when built with
+	// JMBGB_PROFILE_GUEST, see GuestProfile.h.
+	bool profileGuest(std::string filename, int interval, std::string sym_filename);
+	// Count the CPU's reads and writes at every address from now on and
+	// write them to <name>.csv and <name>.png at shutdown. Only available
+	// when built with JMBGB_MEMORY_HEATMAP, see MemoryHeatmap.h.
+	bool recordHeatmap(std::string name);
+
+	// Keep the last num_records instructions run (0 turns it off), see
+	// TraceBuffer.h. With a crash_filename they're also written there if
+	// the process crashes.
+	void setTrace(uint32_t num_records, std::string crash_filename);
+	bool dumpTrace(std::string filename);
+	// <rom name>.trace, next to the ROM
+	std::string getTraceFilename();
+
+	// memory as a debugger sees it, see MMU::peekByte()
+	BYTE peekMemory(WORD address);
+	// a write as the CPU would make it, so registers and banking react
+	void pokeMemory(WORD address, BYTE val);
 
 private:
     std::string filename_;
@@ -40,6 +141,7 @@ private:
 	bool running_;
 
 	int current_clocks_;
+	uint64_t total_clocks_;
 	int div_clocks_;
 	int timer_clocks_;
 	int clocks_until_next_mode_;
@@ -48,13 +150,58 @@ private:
 	int timer_mode_clocks_[4];
 	bool timer_running_;
 
-	SDL_Event evnt;
-	SDL_Surface *screen;
+	// frame pacing
+	FramePacer pacer_;
+	double speed_;
+	double turbo_speed_;
+	bool turbo_;
+	bool pacing_stats_;
+	int frames_since_stats_;
+	int frames_since_save_flush_;
+
+	// scratch space for save states
+	std::vector<BYTE> state_buffer_;
+	bool readStateHeader(StateReader &r);
+	bool readState(StateReader &r);
+
+	// rewind
+	RewindBuffer rewind_;
+	int rewind_interval_;
+	int frames_since_rewind_;
+	bool rewinding_;
+	void updateRewind();
+
+	bool frame_done_; // set when a frame finishes, for runFrame()
+	uint64_t frame_count_;
+
+	// shared memory export, NULL when off
+	FrameExport *export_;
+	void publishFrame();
+
+	// opcode profile, NULL when off
+	OpcodeProfile *profile_;
+	std::string profile_filename_;
+	GuestProfile *guest_profile_;
+	std::string guest_profile_filename_;
+	// memory heatmap, NULL when off
+	MemoryHeatmap *heatmap_;
+	std::string heatmap_name_;
+
+	// instruction trace, NULL when off
+	TraceBuffer *trace_;
+
+	// the ROM's filename without its extension
+	std::string getBaseFilename();
 
-	// SDL Timer for frame rate cap
-	uint32_t start_ticks_;
+	// input
+	BYTE buttons_; // setButton() state
+	InputSource *input_source_;
+	bool exit_at_input_end_;
+	MovieRecorder recorder_;
+	MoviePlayer movie_;
+	void applyInput();
 
-	void handleInput();
+	void initSettings();
 	void spinUntilNextFrame();
 };
 
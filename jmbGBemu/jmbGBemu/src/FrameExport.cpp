@@ -0,0 +1,167 @@
+// FrameExport.cpp
+// Author: Jason Blanchard
+// Implement FrameExport and FrameExportReader, a ring of frames in shared
+// memory guarded by a sequence lock per slot.
+
+#include "FrameExport.h"
+
+#include <cstring>
+#include <thread>
+
+// Give up on a slot being written this many times in a row (yielding in
+// between); the writer would have to be publishing faster than we can copy.
+const int EXPORT_READ_TRIES = 16;
+
+// ---------------------------------------------------------------------------
+// FrameExport
+
+FrameExport::FrameExport() {
+	header_ = NULL;
+	published_ = 0;
+}
+
+FrameExport::~FrameExport() {
+	close();
+}
+
+bool FrameExport::create(const std::string &name, int num_slots) {
+	close();
+
+	if (num_slots < 1)
+		return false;
+
+	size_t size = sizeof(ExportHeader) + (size_t)num_slots * sizeof(ExportSlot);
+	if (!shm_.createShared(name, size))
+		return false;
+
+	// zero filled, so every slot starts at sequence 0 (nothing in it)
+	header_ = (ExportHeader *)shm_.getData();
+	header_->magic = EXPORT_MAGIC;
+	header_->version = EXPORT_VERSION;
+	header_->num_slots = (uint32_t)num_slots;
+	header_->slot_size = (uint32_t)sizeof(ExportSlot);
+	header_->published.store(0, std::memory_order_release);
+	published_ = 0;
+	return true;
+}
+
+void FrameExport::close() {
+	shm_.close();
+	header_ = NULL;
+}
+
+bool FrameExport::isOpen() {
+	return header_ != NULL;
+}
+
+ExportSlot *FrameExport::getSlot(uint64_t index) {
+	return (ExportSlot *)(shm_.getData() + sizeof(ExportHeader) +
+		(size_t)(index % header_->num_slots) * header_->slot_size);
+}
+
+// The sequence goes odd while the slot is being written and even again once
+// it's done, so a reader that sees the same even number before and after its
+// copy knows it got one whole frame.
+ExportSlot *FrameExport::beginPublish(uint64_t frame) {
+	ExportSlot *slot = getSlot(published_);
+	uint32_t seq = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->index = published_;
+	slot->frame = frame;
+	return slot;
+}
+
+void FrameExport::endPublish() {
+	ExportSlot *slot = getSlot(published_);
+	uint32_t seq = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(seq + 1, std::memory_order_release);
+	header_->published.store(++published_, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// FrameExportReader
+
+FrameExportReader::FrameExportReader() {
+	header_ = NULL;
+}
+
+bool FrameExportReader::open(const std::string &name) {
+	close();
+
+	if (!shm_.openShared(name))
+		return false;
+
+	const ExportHeader *header = (const ExportHeader *)shm_.getData();
+	if (shm_.getSize() < sizeof(ExportHeader) || header->magic != EXPORT_MAGIC ||
+		header->version != EXPORT_VERSION || header->slot_size != sizeof(ExportSlot) ||
+		shm_.getSize() < sizeof(ExportHeader) + (size_t)header->num_slots * header->slot_size) {
+		close();
+		return false;
+	}
+
+	header_ = header;
+	return true;
+}
+
+void FrameExportReader::close() {
+	shm_.close();
+	header_ = NULL;
+}
+
+uint64_t FrameExportReader::getPublished() {
+	return header_ ? header_->published.load(std::memory_order_acquire) : 0;
+}
+
+const ExportSlot *FrameExportReader::getSlot(uint64_t index) {
+	return (const ExportSlot *)(shm_.getData() + sizeof(ExportHeader) +
+		(size_t)(index % header_->num_slots) * header_->slot_size);
+}
+
+bool FrameExportReader::read(uint64_t index, ExportSlot &out) {
+	if (header_ == NULL || index >= getPublished())
+		return false;
+
+	const ExportSlot *slot = getSlot(index);
+	for (int tries = 0; tries < EXPORT_READ_TRIES; ++tries) {
+		if (tries > 0)
+			std::this_thread::yield();
+
+		uint32_t before = slot->sequence.load(std::memory_order_acquire);
+		if (before & 1)
+			continue;
+
+		uint64_t found = slot->index;
+		out.frame = slot->frame;
+		memcpy(out.screen, slot->screen, sizeof(out.screen));
+		memcpy(out.work_ram, slot->work_ram, sizeof(out.work_ram));
+		memcpy(out.high_ram, slot->high_ram, sizeof(out.high_ram));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->sequence.load(std::memory_order_relaxed) != before)
+			continue;
+
+		// a whole frame, but maybe a later one than asked for
+		if (found != index)
+			return false;
+
+		out.sequence.store(before, std::memory_order_relaxed);
+		out.index = found;
+		return true;
+	}
+
+	return false;
+}
+
+bool FrameExportReader::readLatest(ExportSlot &out) {
+	for (int tries = 0; tries < EXPORT_READ_TRIES; ++tries) {
+		uint64_t published = getPublished();
+		if (published == 0)
+			return false;
+		if (read(published - 1, out))
+			return true;
+	}
+
+	return false;
+}
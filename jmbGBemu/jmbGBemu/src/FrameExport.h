@@ -0,0 +1,96 @@
+// FrameExport.h
+// Author: Jason Blanchard
+// Define FrameExport and FrameExportReader, which share each finished frame
+// (and work/high RAM at that point) with other processes through a ring of
+// slots in named shared memory. The emulator never waits on a reader: each
+// slot is guarded by a sequence lock, so a reader copies a slot out and
+// checks nothing was written over it meanwhile, and a slow reader just
+// finds its frames overwritten and skips ahead.
+//
+// Layout, native byte order, starting with an ExportHeader and followed by
+// num_slots slots of slot_size bytes each:
+//
+//     header:  "JMBX", version, num_slots, slot_size, frames published
+//     slot:    sequence (odd while being written), frame index, frame
+//              number, 160x144 shades, WRAM (C000-DFFF), HRAM (FF80-FFFF)
+//
+// Frame index n is published into slot n % num_slots.
+
+#ifndef _FRAMEEXPORT_H
+#define _FRAMEEXPORT_H
+
+#include <string>
+#include <atomic>
+
+#include "definitions.h"
+#include "MappedFile.h"
+
+const uint32_t EXPORT_MAGIC = 0x584D424A; // "JMBX"
+const uint32_t EXPORT_VERSION = 1;
+const int EXPORT_DEFAULT_SLOTS = 8;
+
+struct alignas(64) ExportHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_slots;
+	uint32_t slot_size;
+	std::atomic<uint64_t> published; // frames published so far
+};
+
+struct alignas(64) ExportSlot {
+	std::atomic<uint32_t> sequence;
+	uint32_t reserved;
+	uint64_t index;          // frame index, counting publishes from 0
+	uint64_t frame;          // emulator frame count when it was published
+	BYTE screen[144 * 160];
+	BYTE work_ram[0x2000];
+	BYTE high_ram[0x80];
+};
+
+class FrameExport {
+public:
+	FrameExport();
+	~FrameExport();
+
+	bool create(const std::string &name, int num_slots);
+	void close();
+	bool isOpen();
+
+	// Fill in the screen and RAM of the slot returned by beginPublish(), then
+	// call endPublish() to make it visible.
+	ExportSlot *beginPublish(uint64_t frame);
+	void endPublish();
+
+private:
+	MappedFile shm_;
+	ExportHeader *header_;
+	uint64_t published_;
+
+	ExportSlot *getSlot(uint64_t index);
+};
+
+class FrameExportReader {
+public:
+	FrameExportReader();
+
+	bool open(const std::string &name);
+	void close();
+
+	// Frames published so far; the newest is getPublished() - 1.
+	uint64_t getPublished();
+
+	// Copy frame index out into slot. Returns false if it hasn't been
+	// published yet or has already been written over.
+	bool read(uint64_t index, ExportSlot &slot);
+
+	// Copy out the newest frame. Returns false if there isn't one yet.
+	bool readLatest(ExportSlot &slot);
+
+private:
+	MappedFile shm_;
+	const ExportHeader *header_;
+
+	const ExportSlot *getSlot(uint64_t index);
+};
+
+#endif
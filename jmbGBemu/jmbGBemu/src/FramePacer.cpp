@@ -0,0 +1,174 @@
+// FramePacer.cpp
+// Author: Jason Blanchard
+// Implement FramePacer class, which keeps the emulator in step with real time by
+// sleeping until absolute frame deadlines and records how well it managed.
+
+#include "FramePacer.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <time.h>
+#include <errno.h>
+#endif
+
+// How far behind we let the timeline get before giving up on catching up.
+static const double MAX_LAG = 0.1; // seconds
+
+// Bounds on how early we wake from the OS sleep to spin out the remainder.
+static const double MIN_SPIN = 0.0002;
+#ifdef _WIN32
+static const double MAX_SPIN = 0.003; // default scheduler tick is coarse here
+#else
+static const double MAX_SPIN = 0.001;
+#endif
+
+FramePacer::FramePacer() {
+	oversleep_ = MIN_SPIN;
+	reset();
+}
+
+FramePacer::~FramePacer() { }
+
+void FramePacer::reset() {
+	anchor_ = clock::now();
+	frames_ = 0;
+	fps_ = 0.0;
+	have_last_frame_ = false;
+	history_count_ = 0;
+	history_pos_ = 0;
+	drift_ = 0.0;
+	resyncs_ = 0;
+	missed_deadlines_ = 0;
+}
+
+void FramePacer::waitForNextFrame(double fps) {
+	using namespace std::chrono;
+
+	clock::time_point now = clock::now();
+
+	// a rate change starts a new timeline
+	if (fps != fps_ || fps <= 0.0) {
+		fps_ = fps;
+		anchor_ = now;
+		frames_ = 0;
+	}
+
+	if (fps > 0.0) {
+		++frames_;
+		duration<double> offset(frames_ / fps);
+		clock::time_point deadline = anchor_ + duration_cast<clock::duration>(offset);
+
+		if (deadline > now) {
+			sleepUntil(deadline);
+			now = clock::now();
+		} else {
+			++missed_deadlines_;
+		}
+
+		drift_ = duration<double>(now - deadline).count();
+		if (drift_ > MAX_LAG) {
+			// we've fallen well behind (host stall, debugger, etc). Re-anchor
+			// rather than fast-forwarding through the backlog.
+			anchor_ = now;
+			frames_ = 0;
+			drift_ = 0.0;
+			++resyncs_;
+		}
+	}
+
+	recordFrame(now);
+}
+
+// Sleep for most of the wait and spin out the last fraction of a millisecond,
+// since OS sleeps routinely overshoot by more than that.
+void FramePacer::sleepUntil(clock::time_point deadline) {
+	using namespace std::chrono;
+
+	clock::time_point wake = deadline - duration_cast<clock::duration>(
+		duration<double>(std::min(std::max(oversleep_ * 2.0, MIN_SPIN), MAX_SPIN)));
+	clock::time_point now = clock::now();
+
+	if (wake > now) {
+#ifdef _WIN32
+		std::this_thread::sleep_until(wake);
+#else
+		// turn the wake time into an absolute CLOCK_MONOTONIC deadline so an
+		// interrupted sleep can simply be restarted without drifting
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		int64_t ns = (int64_t)ts.tv_nsec + duration_cast<nanoseconds>(wake - now).count();
+		ts.tv_sec += (time_t)(ns / 1000000000);
+		ts.tv_nsec = (long)(ns % 1000000000);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) { }
+#endif
+		// track how late the OS woke us up
+		double late = duration<double>(clock::now() - wake).count();
+		oversleep_ = oversleep_ * 0.9 + std::max(late, 0.0) * 0.1;
+	}
+
+	while (clock::now() < deadline)
+		std::this_thread::yield();
+}
+
+void FramePacer::recordFrame(clock::time_point now) {
+	if (have_last_frame_) {
+		frame_times_[history_pos_] =
+			(float)std::chrono::duration<double, std::micro>(now - last_frame_).count();
+		history_pos_ = (history_pos_ + 1) % HISTORY_SIZE;
+		if (history_count_ < HISTORY_SIZE)
+			++history_count_;
+	}
+
+	last_frame_ = now;
+	have_last_frame_ = true;
+}
+
+double FramePacer::getFrameTimePercentile(double p) {
+	if (history_count_ == 0)
+		return 0.0;
+
+	float sorted[HISTORY_SIZE];
+	std::copy(frame_times_, frame_times_ + history_count_, sorted);
+
+	int n = (int)(std::min(std::max(p, 0.0), 100.0) / 100.0 * (history_count_ - 1) + 0.5);
+	std::nth_element(sorted, sorted + n, sorted + history_count_);
+
+	return sorted[n] / 1000.0;
+}
+
+double FramePacer::getMaxFrameTime() {
+	if (history_count_ == 0)
+		return 0.0;
+
+	return *std::max_element(frame_times_, frame_times_ + history_count_) / 1000.0;
+}
+
+double FramePacer::getDrift() {
+	return drift_ * 1000.0;
+}
+
+int FramePacer::getResyncs() {
+	return resyncs_;
+}
+
+int FramePacer::getMissedDeadlines() {
+	return missed_deadlines_;
+}
+
+// the log only formats integers and strings
+static std::string formatMs(double ms) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.3f", ms);
+	return text;
+}
+
+void FramePacer::printStats() {
+	EMULOG_INFO("Frame time p50: %s ms, p99: %s ms, max: %s ms", formatMs(getFrameTimePercentile(50.0)),
+		formatMs(getFrameTimePercentile(99.0)), formatMs(getMaxFrameTime()));
+	EMULOG_INFO("Drift: %s ms, missed deadlines: %d, resyncs: %d", formatMs(getDrift()),
+		missed_deadlines_, resyncs_);
+}
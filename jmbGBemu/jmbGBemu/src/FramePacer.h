@@ -0,0 +1,68 @@
+// FramePacer.h
+// Author: Jason Blanchard
+// Define FramePacer class, which keeps the emulator in step with real time by
+// sleeping until absolute frame deadlines and records how well it managed.
+
+#ifndef _FRAMEPACER_H
+#define _FRAMEPACER_H
+
+#include <chrono>
+#include <cstdint>
+
+class FramePacer {
+public:
+	FramePacer();
+	~FramePacer();
+
+	// Start a new timeline from now.
+	void reset();
+
+	// Block until the deadline of the next frame at the given rate. A rate
+	// <= 0 doesn't wait at all, but still records frame times.
+	void waitForNextFrame(double fps);
+
+	// Frame-to-frame times over the recent history, in milliseconds.
+	// p is in the range 0-100 (e.g. 50 for the median, 99 for the tail).
+	double getFrameTimePercentile(double p);
+	double getMaxFrameTime();
+
+	// How far real time is from where the timeline says it should be, in
+	// milliseconds. Positive means we are running behind.
+	double getDrift();
+	int getResyncs();
+	int getMissedDeadlines();
+
+	void printStats();
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	static const int HISTORY_SIZE = 1024;
+
+	// The timeline: deadline n is anchor_ + n * period, computed fresh each
+	// frame so rounding never accumulates.
+	clock::time_point anchor_;
+	uint64_t frames_;
+	double fps_;
+
+	clock::time_point last_frame_;
+	bool have_last_frame_;
+
+	// circular history of frame times (microseconds)
+	float frame_times_[HISTORY_SIZE];
+	int history_count_;
+	int history_pos_;
+
+	// smoothed oversleep of the OS sleep call (seconds), used to decide how
+	// early to wake up and spin for the rest
+	double oversleep_;
+
+	double drift_;
+	int resyncs_;
+	int missed_deadlines_;
+
+	void sleepUntil(clock::time_point deadline);
+	void recordFrame(clock::time_point now);
+};
+
+#endif
@@ -0,0 +1,145 @@
+// Frontend.cpp
+// Author: Jason Blanchard
+// Implement Frontend class, the SDL window around an Emulator.
+
+#include "Frontend.h"
+#include "Emulator.h"
+
+#include <iostream>
+
+Frontend::Frontend() {
+	screen_ = NULL;
+	palette_ = PALETTE_GREEN;
+}
+
+Frontend::~Frontend() {
+	close();
+}
+
+bool Frontend::open() {
+	if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0) {
+		std::cout << "Couldn't start SDL: " << SDL_GetError() << "\n";
+		return false;
+	}
+
+	screen_ = SDL_SetVideoMode(160, 144, 32, SDL_SWSURFACE);
+	if (screen_ == NULL) {
+		std::cout << "Couldn't open a window: " << SDL_GetError() << "\n";
+		SDL_Quit();
+		return false;
+	}
+
+	setPalette(palette_);
+	return true;
+}
+
+void Frontend::close() {
+	if (screen_ == NULL)
+		return;
+
+	screen_ = NULL;
+	SDL_Quit();
+}
+
+void Frontend::setPalette(const Palette &palette) {
+	palette_ = palette;
+
+	// colours depend on the pixel format, so wait for the window
+	if (screen_ == NULL)
+		return;
+
+	for (int i = 0; i < 4; ++i)
+		colors_[i] = SDL_MapRGB(screen_->format, palette.rgb[i][0], palette.rgb[i][1], palette.rgb[i][2]);
+}
+
+// Input is read once a frame, between frames.
+void Frontend::run(Emulator *emu) {
+	while (emu->isRunning()) {
+		handleInput(emu);
+		emu->runFrame();
+		present(emu->getFrameBuffer());
+	}
+}
+
+// Game Boy button for a key, if it's one of ours.
+static bool getButton(SDLKey key, Button &b) {
+	switch (key) {
+	case SDLK_RETURN: b = BUTTON_START; return true;
+	case SDLK_RSHIFT: b = BUTTON_SELECT; return true;
+	case SDLK_a: b = BUTTON_A; return true;
+	case SDLK_s: b = BUTTON_B; return true;
+	case SDLK_RIGHT: b = BUTTON_RIGHT; return true;
+	case SDLK_LEFT: b = BUTTON_LEFT; return true;
+	case SDLK_UP: b = BUTTON_UP; return true;
+	case SDLK_DOWN: b = BUTTON_DOWN; return true;
+	default: return false;
+	}
+}
+
+void Frontend::handleInput(Emulator *emu) {
+	Button b;
+
+	while (SDL_PollEvent(&evnt_)) {
+		if (evnt_.type == SDL_KEYDOWN) {
+			SDLKey key = evnt_.key.keysym.sym;
+			if (getButton(key, b)) {
+				emu->setButton(b, true);
+			}
+			if (key == SDLK_TAB) {
+				emu->setTurbo(true);
+			}
+			if (key == SDLK_F5) {
+				emu->saveStateFile(emu->getStateFilename());
+			}
+			if (key == SDLK_F8) {
+				emu->loadStateFile(emu->getStateFilename());
+			}
+			if (key == SDLK_F9) {
+				emu->dumpTrace(emu->getTraceFilename());
+			}
+			if (key == SDLK_BACKSPACE) {
+				emu->setRewinding(true);
+			}
+			if (key == SDLK_ESCAPE) {
+				emu->setRunning(false);
+			}
+		} else if (evnt_.type == SDL_KEYUP) {
+			SDLKey key = evnt_.key.keysym.sym;
+			if (getButton(key, b)) {
+				emu->setButton(b, false);
+			}
+			if (key == SDLK_TAB) {
+				emu->setTurbo(false);
+			}
+			if (key == SDLK_BACKSPACE) {
+				emu->setRewinding(false);
+			}
+		} else if (evnt_.type == SDL_QUIT) {
+			emu->setRunning(false);
+		}
+	}
+}
+
+// Convert the finished frame to screen colours and put it up. The frame is
+// only shade numbers up to this point, so this is the one place each pixel
+// gets turned into a 32-bit colour.
+void Frontend::present(const BYTE *frame) {
+	if (screen_ == NULL)
+		return;
+
+	Uint32 colors[4] = { colors_[0], colors_[1], colors_[2], colors_[3] };
+
+	for (int j = 0; j < 144; ++j) {
+		Uint32 *p = (Uint32 *)((BYTE *)screen_->pixels + j*screen_->pitch);
+		const BYTE *src = frame + j*160;
+
+		for (int i = 0; i < 160; i += 4) {
+			p[i] = colors[src[i]];
+			p[i+1] = colors[src[i+1]];
+			p[i+2] = colors[src[i+2]];
+			p[i+3] = colors[src[i+3]];
+		}
+	}
+
+	SDL_UpdateRect(screen_, 0, 0, 0, 0);
+}
@@ -0,0 +1,39 @@
+// Frontend.h
+// Author: Jason Blanchard
+// Define Frontend class, the SDL window around an Emulator. It reads the
+// keyboard, runs the emulator a frame at a time and puts each finished frame
+// up on screen. The emulator itself knows nothing about SDL.
+
+#ifndef _FRONTEND_H
+#define _FRONTEND_H
+
+#include <SDL.h>
+
+#include "definitions.h"
+
+class Frontend {
+public:
+	Frontend();
+	~Frontend();
+
+	// Open the window. Returns false if SDL can't give us one.
+	bool open();
+	void close();
+
+	// Map the four shades onto screen colours.
+	void setPalette(const Palette &palette);
+
+	// Run until the emulator stops or the window is closed.
+	void run(Emulator *emu);
+
+private:
+	SDL_Surface *screen_;
+	SDL_Event evnt_;
+	Palette palette_;
+	Uint32 colors_[4]; // screen colour for each shade
+
+	void handleInput(Emulator *emu);
+	void present(const BYTE *frame);
+};
+
+#endif
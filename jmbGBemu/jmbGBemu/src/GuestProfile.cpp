@@ -0,0 +1,186 @@
+// GuestProfile.cpp
+// Author: Jason Blanchard
+// Implement GuestProfile class, which samples the game's call stack and
+// writes it out as folded stacks.
+
+#include "GuestProfile.h"
+#include "Log.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+
+const uint32_t KEY_INTERRUPT = 0x80000000;
+// not a place in memory; marks a sample taken while halted
+const uint32_t KEY_HALT = 0xFFFFFFFF;
+const int BANK_NOT_ROM = 0x7FFF;
+
+GuestProfile::GuestProfile(int interval) {
+	interval_ = interval > 0 ? interval : GUEST_PROFILE_DEFAULT_INTERVAL;
+	countdown_ = interval_;
+	stack_.reserve(GUEST_PROFILE_MAX_DEPTH);
+}
+
+uint32_t GuestProfile::makeKey(int bank, WORD address) {
+	if (bank < 0 || address >= 0x8000)
+		bank = BANK_NOT_ROM;
+	return ((uint32_t)(bank & 0x7FFF) << 16) | address;
+}
+
+bool GuestProfile::loadSymbols(const std::string &filename) {
+	std::ifstream file(filename.c_str());
+	if (!file.is_open())
+		return false;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t comment = line.find(';');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		// BB:AAAA Name
+		std::istringstream in(line);
+		std::string location, name;
+		if (!(in >> location >> name))
+			continue;
+		size_t colon = location.find(':');
+		if (colon == std::string::npos)
+			continue;
+
+		char *end;
+		unsigned long bank = strtoul(location.substr(0, colon).c_str(), &end, 16);
+		if (*end != '\0')
+			continue;
+		unsigned long address = strtoul(location.substr(colon + 1).c_str(), &end, 16);
+		if (*end != '\0' || address > 0xFFFF)
+			continue;
+
+		symbols_[makeKey((int)bank, (WORD)address)] = name;
+	}
+
+	return true;
+}
+
+void GuestProfile::enter(int bank, WORD address, WORD sp, bool interrupt) {
+	if ((int)stack_.size() >= GUEST_PROFILE_MAX_DEPTH)
+		return;
+
+	Frame frame;
+	frame.function = makeKey(bank, address) | (interrupt ? KEY_INTERRUPT : 0);
+	frame.sp = sp;
+	stack_.push_back(frame);
+}
+
+// Calls are matched to returns by where their return address is on the
+// stack rather than one for one, so a RET the game set up itself (pushing
+// an address to jump to) doesn't unbalance anything, and a game that resets
+// SP and starts over drops its old frames on the next RET.
+void GuestProfile::leave(WORD sp) {
+	while (!stack_.empty() && stack_.back().sp <= sp)
+		stack_.pop_back();
+}
+
+void GuestProfile::resetStack() {
+	stack_.clear();
+}
+
+void GuestProfile::sample(int bank, WORD pc) {
+	// without symbols there's no sensible name for where in the function we
+	// are, and a frame per address would just be noise
+	addSample(!symbols_.empty(), makeKey(bank, pc));
+}
+
+void GuestProfile::sampleHalted() {
+	addSample(true, KEY_HALT);
+}
+
+// Count the current stack, with leaf on top if there is one.
+void GuestProfile::addSample(bool has_leaf, uint32_t leaf) {
+	countdown_ += interval_;
+	if (countdown_ <= 0)
+		countdown_ = interval_;
+
+	scratch_.clear();
+	for (size_t i = 0; i < stack_.size(); ++i)
+		scratch_.push_back(stack_[i].function);
+	if (has_leaf)
+		scratch_.push_back(leaf);
+
+	++samples_[scratch_];
+}
+
+std::string GuestProfile::getName(uint32_t key, bool nearest) {
+	uint32_t location = key & ~KEY_INTERRUPT;
+	std::map<uint32_t, std::string>::const_iterator it = symbols_.upper_bound(location);
+	if (it != symbols_.begin()) {
+		--it;
+		if (it->first == location || (nearest && (it->first >> 16) == (location >> 16)))
+			return it->second;
+	}
+
+	if (key & KEY_INTERRUPT) {
+		switch (location & 0xFFFF) {
+		case 0x40: return "int_vblank";
+		case 0x48: return "int_stat";
+		case 0x50: return "int_timer";
+		case 0x58: return "int_serial";
+		case 0x60: return "int_joypad";
+		}
+	}
+
+	char name[16];
+	if ((int)(location >> 16) == BANK_NOT_ROM)
+		snprintf(name, sizeof(name), "%04X", location & 0xFFFF);
+	else
+		snprintf(name, sizeof(name), "%02X:%04X", location >> 16, location & 0xFFFF);
+	return name;
+}
+
+bool GuestProfile::write(const std::string &filename) {
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't write guest profile %s", filename);
+		return false;
+	}
+
+	// different addresses can come out with the same names, so add up by
+	// the text that's written
+	std::map<std::string, uint64_t> folded;
+	std::map<std::vector<uint32_t>, uint64_t>::const_iterator it;
+	for (it = samples_.begin(); it != samples_.end(); ++it) {
+		const std::vector<uint32_t> &keys = it->first;
+		bool halted = !keys.empty() && keys.back() == KEY_HALT;
+		size_t frames = keys.size() - (symbols_.empty() && !halted ? 0 : 1);
+
+		std::string line;
+		for (size_t i = 0; i < frames; ++i) {
+			if (!line.empty())
+				line += ';';
+			line += getName(keys[i], false);
+		}
+		if (halted) {
+			if (!line.empty())
+				line += ';';
+			line += "[halt]";
+		} else if (frames < keys.size()) {
+			// where the sample landed, unless that's the top of the function
+			std::string leaf = getName(keys.back(), true);
+			if (frames == 0 || leaf != getName(keys[frames - 1], false)) {
+				if (!line.empty())
+					line += ';';
+				line += leaf;
+			}
+		}
+		if (line.empty())
+			line = "top";
+
+		folded[line] += it->second;
+	}
+
+	std::map<std::string, uint64_t>::const_iterator f;
+	for (f = folded.begin(); f != folded.end(); ++f)
+		file << f->first << ' ' << f->second << '\n';
+
+	return file.good();
+}
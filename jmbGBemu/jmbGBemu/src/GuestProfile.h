@@ -0,0 +1,91 @@
+// GuestProfile.h
+// Author: Jason Blanchard
+// Define GuestProfile class, a sampling profiler for the game's own code.
+// The CPU tells it about every CALL, RST, interrupt and RET so it can keep
+// the game's call stack, and every so many cycles the stack is counted as a
+// sample. The result is written as folded stacks, one line per distinct
+// stack, which flamegraph.pl turns straight into a flame graph:
+//
+//     VBlank;UpdateSprites;CopyOAM 1432
+//
+// Functions are named from a .sym file (lines of "BB:AAAA Name", as written
+// by RGBDS and bgb) when there is one, otherwise as bank:address.
+//
+// The CPU only feeds it when built with JMBGB_PROFILE_GUEST defined; without
+// it Emulator::profileGuest() just reports that profiling isn't available.
+// Time spent in HALT is sampled too, so idle loops show up as [halt].
+
+#ifndef _GUESTPROFILE_H
+#define _GUESTPROFILE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "definitions.h"
+
+const int GUEST_PROFILE_DEFAULT_INTERVAL = 4096;
+
+// Calls deeper than this aren't tracked (returns still unwind properly).
+const int GUEST_PROFILE_MAX_DEPTH = 64;
+
+class GuestProfile {
+public:
+	// sample every interval cycles
+	GuestProfile(int interval);
+
+	// Name functions from a .sym file. Returns false if it can't be read.
+	bool loadSymbols(const std::string &filename);
+
+	// A call or interrupt to address in ROM bank (-1 outside ROM), which
+	// pushed its return address at sp.
+	void enter(int bank, WORD address, WORD sp, bool interrupt);
+	// A RET (or RETI) about to pop its return address from sp.
+	void leave(WORD sp);
+	// Forget the stack, e.g. after loading a save state.
+	void resetStack();
+
+	// Count cycles spent on the instruction at pc. Returns true when it's
+	// time for sample().
+	bool addCycles(int cycles) {
+		countdown_ -= cycles;
+		return countdown_ <= 0;
+	}
+	void sample(int bank, WORD pc);
+	// A sample taken while the CPU is halted, counted as a [halt] frame on
+	// top of the stack.
+	void sampleHalted();
+
+	// Write the samples to filename as folded stacks.
+	bool write(const std::string &filename);
+
+private:
+	struct Frame {
+		uint32_t function; // see makeKey()
+		WORD sp;
+	};
+
+	int interval_;
+	int countdown_;
+	std::vector<Frame> stack_;
+
+	// samples by stack, outermost function first; with symbols loaded the
+	// last entry is where the sample landed, and halted samples end in
+	// KEY_HALT either way
+	std::map<std::vector<uint32_t>, uint64_t> samples_;
+	std::vector<uint32_t> scratch_;
+
+	// keyed like functions
+	std::map<uint32_t, std::string> symbols_;
+
+	// bank in the top half (0x7FFF outside ROM), address in the bottom, and
+	// the top bit set for an interrupt handler
+	static uint32_t makeKey(int bank, WORD address);
+	void addSample(bool has_leaf, uint32_t leaf);
+	// nearest falls back to the closest symbol before the address, for
+	// places inside a function rather than the start of one
+	std::string getName(uint32_t key, bool nearest);
+};
+
+#endif
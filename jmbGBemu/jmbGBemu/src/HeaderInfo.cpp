@@ -4,46 +4,68 @@
 // the header of the ROM file.
 
 #include "HeaderInfo.h"
+#include "Log.h"
+
+#include <cstring>
 
 void HeaderInfo::print_info() {
-	std::cout << "Game name: ";
-	for (int i = 0; i < 16; ++i) {
-		if (game_name_[i] != 0x00)
-			std::cout << game_name_[i];
-	}
-	std::cout << "\n";
+	char name[17];
+	memcpy(name, game_name_, 16);
+	name[16] = '\0';
+	EMULOG_INFO("Game name: %s", name);
 
 	if (gbc_flag_ == 0x80)
-		std::cout << "Game Boy Color game.\n";
+		EMULOG_INFO("Game Boy Color game.");
 	
 	if (gb_sgb_flag_ == 0x00)
-		std::cout << "Original Game Boy game.\n";
+		EMULOG_INFO("Original Game Boy game.");
 	else
-		std::cout << "Super Game Boy game.\n";
+		EMULOG_INFO("Super Game Boy game.");
 
-	std::cout << "Cartridge type: ";
 	if (cartridge_type_ == 0x00)
-		std::cout << "ROM only.\n";
+		EMULOG_INFO("Cartridge type: ROM only.");
 	else if (cartridge_type_ == 0x01)
-		std::cout << "ROM+MBC1.\n";
+		EMULOG_INFO("Cartridge type: ROM+MBC1.");
+	else
+		EMULOG_INFO("Cartridge type: %02X", cartridge_type_);
 
-	std::cout << "ROM size: ";
 	if (rom_size_ == 0x00)
-		std::cout << "32 KB; 2 banks.\n";
+		EMULOG_INFO("ROM size: 32 KB; 2 banks.");
 	else if (rom_size_ == 0x01)
-		std::cout << "64 KB; 4 banks.\n";
+		EMULOG_INFO("ROM size: 64 KB; 4 banks.");
+	else if (rom_size_ <= 0x08)
+		EMULOG_INFO("ROM size: %d KB; %d banks.", 32 << rom_size_, 2 << rom_size_);
+	else
+		EMULOG_INFO("ROM size: %02X", rom_size_);
 
-	std::cout << "RAM size: ";
 	if (ram_size_ == 0x00)
-		std::cout << "None.\n";
+		EMULOG_INFO("RAM size: None.");
 	else if (ram_size_ == 0x01 || ram_size_ == 0x02)
-		std::cout << "8KB; 1 bank.\n";
+		EMULOG_INFO("RAM size: 8KB; 1 bank.");
 	else if (ram_size_ == 0x03)
-		std::cout << "32KB; 4 banks.\n";
+		EMULOG_INFO("RAM size: 32KB; 4 banks.");
+	else
+		EMULOG_INFO("RAM size: %02X", ram_size_);
 
-	std::cout << "Destination code: ";
 	if (destination_code_ == 0x00)
-		std::cout << "Japanese.\n";
+		EMULOG_INFO("Destination code: Japanese.");
 	else
-		std::cout << "non-Japanese.\n";
+		EMULOG_INFO("Destination code: non-Japanese.");
+}
+
+int HeaderInfo::getRamSize() {
+	switch (ram_size_) {
+	case 0x01:
+		return 0x800;
+	case 0x02:
+		return 0x2000;
+	case 0x03:
+		return 0x8000;
+	case 0x04:
+		return 0x20000;
+	case 0x05:
+		return 0x10000;
+	default:
+		return 0;
+	}
 }
\ No newline at end of file
@@ -21,6 +21,9 @@ public:
 	BYTE destination_code_; // 00h = Japanese, 01h = non-Japanese
 
 	void print_info();
+
+	// size of the cartridge's external RAM in bytes, from ram_size_
+	int getRamSize();
 };
 
 #endif
\ No newline at end of file
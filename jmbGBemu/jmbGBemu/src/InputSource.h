@@ -0,0 +1,29 @@
+// InputSource.h
+// Author: Jason Blanchard
+// Define InputSource, anything that can drive the joypad in place of the
+// keyboard. The emulator asks for the buttons once at the start of each
+// frame, so given the same answers a run always plays out the same way.
+
+#ifndef _INPUTSOURCE_H
+#define _INPUTSOURCE_H
+
+#include "definitions.h"
+
+// Joypad state as one byte, bit n set when Button n is held.
+inline BYTE buttonBit(Button b) {
+	return (BYTE)(1 << (int)b);
+}
+
+class InputSource {
+public:
+	virtual ~InputSource() { }
+
+	// Buttons held during the given frame (counted from power on).
+	virtual BYTE getButtons(uint64_t frame) = 0;
+
+	// True once the source has nothing more to give, e.g. a movie that has
+	// played to the end.
+	virtual bool isFinished() = 0;
+};
+
+#endif
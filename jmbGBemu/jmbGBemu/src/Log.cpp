@@ -1,26 +1,245 @@
 // Log.cpp
 // Author: Jason Blanchard
-// Define functions and macros to output to logfiles.
+// Implement the Logger, a ring of binary log records that a background
+// thread formats and writes out.
 
 #include "Log.h"
 
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+
 namespace emulog {
-    LogFile::LogFile() { }
-    LogFile::~LogFile() {
-        closeFile();
-    }
-
-    void LogFile::setFile(std::string filename) {
-        file.open(filename.c_str());
-    }
-
-    void LogFile::write(std::string type, std::string message) {
-        if (file.good())
-            file << type << message;
-    }
-
-    void LogFile::closeFile() {
-        if (file.good())
-            file.close();
-    }
-}
\ No newline at end of file
+
+// How long the flusher sleeps when there's nothing to write, in ms.
+const int LOG_IDLE_MS = 2;
+
+static const char *LEVEL_NAMES[] = {
+	"Error: ",
+	"Warning: ",
+	"Info: ",
+	"Debug: "
+};
+
+Logger::Logger() {
+	// record i is free for the producer that claims position i
+	for (int i = 0; i < LOG_RING_SIZE; ++i)
+		ring_[i].sequence.store(i, std::memory_order_relaxed);
+	head_.store(0, std::memory_order_relaxed);
+	tail_ = 0;
+	written_.store(0, std::memory_order_relaxed);
+	dropped_.store(0, std::memory_order_relaxed);
+	dropped_reported_ = 0;
+	level_.store(EMULOG_LEVEL, std::memory_order_relaxed);
+
+	running_ = true;
+	flusher_ = std::thread(&Logger::flushLoop, this);
+}
+
+Logger::~Logger() {
+	// the flusher writes out whatever is left before it stops
+	running_ = false;
+	flusher_.join();
+	closeFile();
+}
+
+// A record whose sequence equals the position being claimed is free; the
+// producer that wins the position fills it in and sets the sequence one past
+// it, which tells the flusher it's ready. The flusher sets it a whole lap on
+// once it's written, freeing it for the producer coming round next time.
+Record *Logger::claim(Level level, const char *format) {
+	uint64_t pos = head_.load(std::memory_order_relaxed);
+	for (;;) {
+		Record *record = &ring_[pos & (LOG_RING_SIZE - 1)];
+		uint64_t seq = record->sequence.load(std::memory_order_acquire);
+		int64_t diff = (int64_t)(seq - pos);
+		if (diff == 0) {
+			if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				record->format = format;
+				record->level = level;
+				record->text_used = 0;
+				return record;
+			}
+		} else if (diff < 0) {
+			// a lap behind: the flusher hasn't got to it yet
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return NULL;
+		} else {
+			pos = head_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void Logger::publish(Record *record) {
+	uint64_t seq = record->sequence.load(std::memory_order_relaxed);
+	record->sequence.store(seq + 1, std::memory_order_release);
+}
+
+bool Logger::setFile(const std::string &filename) {
+	flush();
+
+	std::lock_guard<std::mutex> lock(file_lock_);
+	if (file_.is_open())
+		file_.close();
+	file_.clear();
+	file_.open(filename.c_str());
+	if (!file_.is_open()) {
+		// goes to standard output, as there's no file
+		EMULOG_ERROR("Couldn't open log file %s", filename);
+		return false;
+	}
+	return true;
+}
+
+void Logger::closeFile() {
+	flush();
+
+	std::lock_guard<std::mutex> lock(file_lock_);
+	if (file_.is_open())
+		file_.close();
+}
+
+void Logger::flush() {
+	if (!running_)
+		return;
+
+	uint64_t target = head_.load(std::memory_order_acquire);
+	while (written_.load(std::memory_order_acquire) < target)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void Logger::flushLoop() {
+	for (;;) {
+		bool stopping = !running_;
+		if (!writeRecords()) {
+			if (stopping)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_MS));
+		}
+	}
+}
+
+// Write out every record that's ready. Returns false if there were none.
+bool Logger::writeRecords() {
+	std::string out;
+	uint64_t start = tail_;
+	for (;;) {
+		Record *record = &ring_[tail_ & (LOG_RING_SIZE - 1)];
+		if (record->sequence.load(std::memory_order_acquire) != tail_ + 1)
+			break;
+
+		format(*record, out);
+		record->sequence.store(tail_ + LOG_RING_SIZE, std::memory_order_release);
+		++tail_;
+	}
+
+	uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+	if (dropped != dropped_reported_) {
+		char line[80];
+		snprintf(line, sizeof(line), "%s%llu log messages dropped, the log couldn't keep up\n",
+			LEVEL_NAMES[LEVEL_WARNING], (unsigned long long)(dropped - dropped_reported_));
+		out += line;
+		dropped_reported_ = dropped;
+	}
+
+	if (out.empty())
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(file_lock_);
+		if (file_.is_open()) {
+			file_ << out;
+			file_.flush();
+		} else {
+			std::cout << out;
+			std::cout.flush();
+		}
+	}
+
+	written_.store(tail_, std::memory_order_release);
+	return tail_ != start;
+}
+
+// Expand a record's format string into out, one conversion at a time.
+void Logger::format(const Record &record, std::string &out) {
+	out += LEVEL_NAMES[record.level];
+
+	const char *p = record.format;
+	int n = 0;
+	char spec[16];
+	char field[LOG_TEXT_SIZE + 32];
+	while (*p) {
+		if (*p != '%') {
+			out += *p++;
+			continue;
+		}
+		if (p[1] == '%') {
+			out += '%';
+			p += 2;
+			continue;
+		}
+
+		// flags, width and precision are passed on as they are
+		size_t len = 1 + strspn(p + 1, "-+ #0123456789.");
+		char conv = p[len];
+		if (conv == '\0' || len + 3 >= sizeof(spec) || n >= LOG_MAX_ARGS) {
+			out += *p++;
+			continue;
+		}
+
+		memcpy(spec, p, len);
+		uint64_t arg = record.args[n++];
+		if (conv == 's') {
+			spec[len] = 's';
+			spec[len + 1] = '\0';
+			const char *text = arg < (uint64_t)record.text_used ? &record.text[arg] : "";
+			snprintf(field, sizeof(field), spec, text);
+		} else if (conv == 'c') {
+			spec[len] = 'c';
+			spec[len + 1] = '\0';
+			snprintf(field, sizeof(field), spec, (int)arg);
+		} else if (strchr("diuxX", conv)) {
+			spec[len] = 'l';
+			spec[len + 1] = 'l';
+			spec[len + 2] = conv;
+			spec[len + 3] = '\0';
+			if (conv == 'd' || conv == 'i')
+				snprintf(field, sizeof(field), spec, (long long)arg);
+			else
+				snprintf(field, sizeof(field), spec, (unsigned long long)arg);
+		} else {
+			// not something we know how to format; leave it as it is
+			--n;
+			out += *p++;
+			continue;
+		}
+
+		out += field;
+		p += len + 1;
+	}
+
+	out += '\n';
+}
+
+Logger &getLogger() {
+	static Logger logger;
+	return logger;
+}
+
+bool setFile(const std::string &filename) {
+	return getLogger().setFile(filename);
+}
+
+void setLevel(int max_level) {
+	getLogger().setLevel(max_level);
+}
+
+void closeFile() {
+	getLogger().closeFile();
+}
+
+void flush() {
+	getLogger().flush();
+}
+
+}
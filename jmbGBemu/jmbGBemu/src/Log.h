@@ -1,32 +1,204 @@
 // Log.h
 // Author: Jason Blanchard
-// Define functions and macros to output to logfiles.
+// Define the emulator's log, which hands messages to a background thread so
+// that logging from the CPU/MMU doesn't wait on a file or the console.
+//
+// A message is a printf-style format string, which must be a string literal,
+// and up to four arguments. Integers are stored as they are and strings are
+// copied into the record, so nothing is formatted on the calling thread:
+//
+//     EMULOG_WARNING("Write of %02X to unused register FF%02X", val, reg);
+//
+// Conversions take no length modifiers; every integer is formatted as 64
+// bits. Records go into a fixed ring that any number of threads can post to
+// without locking. If the ring is full the message is dropped and counted
+// rather than holding the emulator up.
+//
+// Levels above EMULOG_LEVEL compile to nothing, arguments included. Build
+// with EMULOG_LEVEL=EMULOG_LEVEL_DEBUG to see debug messages. setLevel()
+// turns levels that are built in down (or off) while running.
 
 #ifndef _LOG_H
 #define _LOG_H
 
-#include <fstream>
 #include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+
+#define EMULOG_LEVEL_NONE 0
+#define EMULOG_LEVEL_ERROR 1
+#define EMULOG_LEVEL_WARNING 2
+#define EMULOG_LEVEL_INFO 3
+#define EMULOG_LEVEL_DEBUG 4
+
+#ifndef EMULOG_LEVEL
+#define EMULOG_LEVEL EMULOG_LEVEL_INFO
+#endif
+
+#if EMULOG_LEVEL >= EMULOG_LEVEL_ERROR
+#define EMULOG_ERROR(...) emulog::post(emulog::LEVEL_ERROR, __VA_ARGS__)
+#else
+#define EMULOG_ERROR(...) ((void)0)
+#endif
+
+#if EMULOG_LEVEL >= EMULOG_LEVEL_WARNING
+#define EMULOG_WARNING(...) emulog::post(emulog::LEVEL_WARNING, __VA_ARGS__)
+#else
+#define EMULOG_WARNING(...) ((void)0)
+#endif
+
+#if EMULOG_LEVEL >= EMULOG_LEVEL_INFO
+#define EMULOG_INFO(...) emulog::post(emulog::LEVEL_INFO, __VA_ARGS__)
+#else
+#define EMULOG_INFO(...) ((void)0)
+#endif
+
+#if EMULOG_LEVEL >= EMULOG_LEVEL_DEBUG
+#define EMULOG_DEBUG(...) emulog::post(emulog::LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define EMULOG_DEBUG(...) ((void)0)
+#endif
 
 namespace emulog {
 
-const std::string ERROR("Error: ");
-const std::string WARNING("Warning: ");
-const std::string INFO("Info: ");
+enum Level {
+	LEVEL_ERROR,
+	LEVEL_WARNING,
+	LEVEL_INFO,
+	LEVEL_DEBUG
+};
+
+const int LOG_MAX_ARGS = 4;
 
-class LogFile {
+// Room for the strings passed to one message, NUL terminated. Longer ones
+// are cut short.
+const int LOG_TEXT_SIZE = 72;
+
+// Records in the ring; a power of two.
+const int LOG_RING_SIZE = 1024;
+
+// One message waiting to be written out. Each is a cache line of its own so
+// threads posting at the same time don't fight over it.
+struct alignas(64) Record {
+	// which lap of the ring this record is on; see Logger::claim()
+	std::atomic<uint64_t> sequence;
+	const char *format;
+	int level;
+	int text_used;
+	uint64_t args[LOG_MAX_ARGS]; // strings are offsets into text
+	char text[LOG_TEXT_SIZE];
+};
+
+class Logger {
 public:
-    LogFile();
-    ~LogFile();
+	Logger();
+	~Logger();
+
+	// Get a record to fill in, or NULL if the ring is full.
+	Record *claim(Level level, const char *format);
+	// Hand a filled in record to the background thread.
+	void publish(Record *record);
 
-    void setFile(std::string filename);
-    void write(std::string type, std::string message);
-    void closeFile();
+	// Drop messages above max_level, one of EMULOG_LEVEL_*.
+	void setLevel(int max_level) { level_.store(max_level, std::memory_order_relaxed); }
+	// Whether a message at level would be written.
+	bool isEnabled(Level level) const { return (int)level < level_.load(std::memory_order_relaxed); }
+
+	// Write to filename instead of standard output.
+	bool setFile(const std::string &filename);
+	void closeFile();
+	// Wait until everything posted so far has been written out.
+	void flush();
 
 private:
-    std::ofstream file;
+	Record ring_[LOG_RING_SIZE];
+	std::atomic<uint64_t> head_; // next record to be claimed
+	uint64_t tail_;              // next record to be written; flusher only
+	std::atomic<uint64_t> written_;
+	std::atomic<uint64_t> dropped_;
+	uint64_t dropped_reported_;
+	std::atomic<int> level_;
+
+	std::atomic<bool> running_;
+	std::thread flusher_;
+
+	// setFile() can be called while the flusher is writing
+	std::mutex file_lock_;
+	std::ofstream file_;
+
+	void flushLoop();
+	bool writeRecords();
+	void format(const Record &record, std::string &out);
 };
 
+Logger &getLogger();
+
+// Helpers for post(), storing one argument each.
+template <typename T>
+inline void pack(Record *record, int &n, const T &val) {
+	record->args[n++] = (uint64_t)val;
+}
+
+inline void pack(Record *record, int &n, const char *val) {
+	int left = LOG_TEXT_SIZE - record->text_used;
+	int length = (int)strlen(val);
+	if (length > left - 1)
+		length = left > 0 ? left - 1 : 0;
+	record->args[n++] = (uint64_t)record->text_used;
+	if (left > 0) {
+		memcpy(&record->text[record->text_used], val, length);
+		record->text[record->text_used + length] = '\0';
+		record->text_used += length + 1;
+	}
+}
+
+inline void pack(Record *record, int &n, char *val) {
+	pack(record, n, (const char *)val);
+}
+
+inline void pack(Record *record, int &n, const std::string &val) {
+	pack(record, n, val.c_str());
+}
+
+inline void packAll(Record *, int &) {
+}
+
+template <typename T, typename... Rest>
+inline void packAll(Record *record, int &n, const T &val, const Rest &... rest) {
+	pack(record, n, val);
+	packAll(record, n, rest...);
+}
+
+// Use the EMULOG_* macros rather than calling this, so disabled levels cost
+// nothing.
+template <typename... Args>
+inline void post(Level level, const char *format, const Args &... args) {
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many arguments to log");
+
+	Logger &logger = getLogger();
+	if (!logger.isEnabled(level))
+		return;
+	Record *record = logger.claim(level, format);
+	if (record == NULL)
+		return;
+
+	int n = 0;
+	packAll(record, n, args...);
+	logger.publish(record);
+}
+
+// Send the log to filename; standard output until this is called.
+bool setFile(const std::string &filename);
+// Only write messages up to max_level (EMULOG_LEVEL_*); EMULOG_LEVEL_NONE
+// silences the log. Everything built in is written until this is called.
+void setLevel(int max_level);
+void closeFile();
+void flush();
+
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,501 @@
+// MBC.cpp
+// Author: Jason Blanchard
+// Implement the memory bank controllers found on cartridges. A controller
+// watches writes to the ROM area and tells the MMU which banks to map, so
+// bank switching just repoints the MMU's page table and ordinary reads never
+// have to ask which controller is fitted.
+
+#include "MBC.h"
+#include "MMU.h"
+#include "Log.h"
+
+#include <ctime>
+
+MBC::MBC(MMU *mmu) {
+	mmu_ = mmu;
+}
+
+MBC::~MBC() { }
+
+MBC *MBC::create(HeaderInfo *hi, MMU *mmu) {
+	switch (hi->cartridge_type_) {
+	case 0x00: // ROM only
+	case 0x08: // ROM+RAM
+	case 0x09: // ROM+RAM+BATTERY
+		return new NoMBC(mmu);
+	case 0x01: // MBC1
+	case 0x02: // MBC1+RAM
+	case 0x03: // MBC1+RAM+BATTERY
+		return new MBC1(mmu);
+	case 0x05: // MBC2
+	case 0x06: // MBC2+BATTERY
+		return new MBC2(mmu);
+	case 0x0F: // MBC3+TIMER+BATTERY
+	case 0x10: // MBC3+TIMER+RAM+BATTERY
+		return new MBC3(mmu, true);
+	case 0x11: // MBC3
+	case 0x12: // MBC3+RAM
+	case 0x13: // MBC3+RAM+BATTERY
+		return new MBC3(mmu, false);
+	case 0x19: // MBC5
+	case 0x1A: // MBC5+RAM
+	case 0x1B: // MBC5+RAM+BATTERY
+	case 0x1C: // MBC5+RUMBLE
+	case 0x1D: // MBC5+RUMBLE+RAM
+	case 0x1E: // MBC5+RUMBLE+RAM+BATTERY
+		return new MBC5(mmu);
+	default:
+		EMULOG_WARNING("Unsupported cartridge type %x, treating it as MBC1.", hi->cartridge_type_);
+		return new MBC1(mmu);
+	}
+}
+
+int MBC::getRamSize(HeaderInfo *hi) {
+	if (hi->cartridge_type_ == 0x05 || hi->cartridge_type_ == 0x06)
+		return 0x200;
+
+	return hi->getRamSize();
+}
+
+bool MBC::hasBattery(HeaderInfo *hi) {
+	switch (hi->cartridge_type_) {
+	case 0x03: // MBC1+RAM+BATTERY
+	case 0x06: // MBC2+BATTERY
+	case 0x09: // ROM+RAM+BATTERY
+	case 0x0F: // MBC3+TIMER+BATTERY
+	case 0x10: // MBC3+TIMER+RAM+BATTERY
+	case 0x13: // MBC3+RAM+BATTERY
+	case 0x1B: // MBC5+RAM+BATTERY
+	case 0x1E: // MBC5+RUMBLE+RAM+BATTERY
+		return true;
+	default:
+		return false;
+	}
+}
+
+BYTE MBC::readRAM(WORD) {
+	return 0xFF;
+}
+
+void MBC::writeRAM(WORD, BYTE) {
+}
+
+int MBC::getSaveDataSize() {
+	return 0;
+}
+
+void MBC::loadSaveData(const BYTE *) {
+}
+
+void MBC::storeSaveData(BYTE *) {
+}
+
+void MBC::catchUpClock() {
+}
+
+// nothing to save for a cartridge without a controller
+void MBC::saveState(StateWriter &) {
+}
+
+void MBC::loadState(StateReader &) {
+}
+
+// ---------------------------------------------------------------------------
+// NoMBC
+
+NoMBC::NoMBC(MMU *mmu) : MBC(mmu) {
+}
+
+void NoMBC::reset() {
+	mmu_->mapROM0(0);
+	mmu_->mapROM1(1);
+	mmu_->mapRAM(0);
+}
+
+void NoMBC::writeROM(WORD, BYTE) {
+	// nothing to control
+}
+
+// ---------------------------------------------------------------------------
+// MBC1
+
+MBC1::MBC1(MMU *mmu) : MBC(mmu) {
+}
+
+void MBC1::reset() {
+	ram_enable_ = false;
+	bank1_ = 1;
+	bank2_ = 0;
+	mode_ = 0;
+	updateMapping();
+}
+
+void MBC1::writeROM(WORD address, BYTE val) {
+	if (address < 0x2000) {
+		// any value with 0xA in the lower 4 bits enables external RAM
+		ram_enable_ = (val & 0x0F) == 0x0A;
+	} else if (address < 0x4000) {
+		// lower 5 bits of the ROM bank; 0 can't be selected and acts as 1
+		bank1_ = val & 0x1F;
+		if (bank1_ == 0)
+			bank1_ = 1;
+	} else if (address < 0x6000) {
+		// upper 2 bits of the ROM bank, or the RAM bank in mode 1
+		bank2_ = val & 0x03;
+	} else {
+		mode_ = val & 0x01;
+	}
+
+	updateMapping();
+}
+
+void MBC1::saveState(StateWriter &w) {
+	w.putBool(ram_enable_);
+	w.put8(bank1_);
+	w.put8(bank2_);
+	w.put8(mode_);
+}
+
+void MBC1::loadState(StateReader &r) {
+	ram_enable_ = r.getBool();
+	bank1_ = r.get8();
+	bank2_ = r.get8();
+	mode_ = r.get8();
+	updateMapping();
+}
+
+void MBC1::updateMapping() {
+	// in mode 1 the upper bits also apply to the 0x0000-0x3FFF area and
+	// select the RAM bank
+	mmu_->mapROM0(mode_ ? (bank2_ << 5) : 0);
+	mmu_->mapROM1((bank2_ << 5) | bank1_);
+	mmu_->mapRAM(ram_enable_ ? (mode_ ? bank2_ : 0) : -1);
+}
+
+// ---------------------------------------------------------------------------
+// MBC2
+
+MBC2::MBC2(MMU *mmu) : MBC(mmu) {
+}
+
+void MBC2::reset() {
+	ram_enable_ = false;
+	rom_bank_ = 1;
+	mmu_->mapROM0(0);
+	mmu_->mapROM1(rom_bank_);
+
+	// the RAM is only 4 bits wide, so it always goes through readRAM/writeRAM
+	mmu_->mapRAM(-1);
+}
+
+void MBC2::writeROM(WORD address, BYTE val) {
+	if (address >= 0x4000)
+		return;
+
+	// bit 8 of the address picks the register
+	if (address & 0x0100) {
+		rom_bank_ = val & 0x0F;
+		if (rom_bank_ == 0)
+			rom_bank_ = 1;
+		mmu_->mapROM1(rom_bank_);
+	} else {
+		ram_enable_ = (val & 0x0F) == 0x0A;
+	}
+}
+
+void MBC2::saveState(StateWriter &w) {
+	w.putBool(ram_enable_);
+	w.put8(rom_bank_);
+}
+
+void MBC2::loadState(StateReader &r) {
+	ram_enable_ = r.getBool();
+	rom_bank_ = r.get8();
+	mmu_->mapROM1(rom_bank_);
+}
+
+// 512 half-bytes, repeated across the whole 0xA000-0xBFFF area. The upper
+// bits aren't connected and read back as 1s.
+BYTE MBC2::readRAM(WORD address) {
+	if (!ram_enable_)
+		return 0xFF;
+
+	return mmu_->getCartRAM()[address & 0x01FF] | 0xF0;
+}
+
+void MBC2::writeRAM(WORD address, BYTE val) {
+	if (ram_enable_)
+		mmu_->getCartRAM()[address & 0x01FF] = val & 0x0F;
+}
+
+// ---------------------------------------------------------------------------
+// MBC3
+
+MBC3::MBC3(MMU *mmu, bool has_rtc) : MBC(mmu) {
+	has_rtc_ = has_rtc;
+
+	// the clock runs on its battery, so it's set up here rather than in reset()
+	rtc_clocks_ = 0;
+	rtc_base_ = mmu_->getClocks();
+	rtc_halt_ = false;
+	rtc_carry_ = false;
+	saved_time_ = 0;
+	for (int i = 0; i < 5; ++i)
+		rtc_latched_[i] = 0;
+}
+
+void MBC3::reset() {
+	ram_enable_ = false;
+	rom_bank_ = 1;
+	ram_select_ = 0;
+	latch_ = 0xFF;
+
+	mmu_->mapROM0(0);
+	mmu_->mapROM1(rom_bank_);
+	updateRAMMapping();
+}
+
+void MBC3::writeROM(WORD address, BYTE val) {
+	if (address < 0x2000) {
+		ram_enable_ = (val & 0x0F) == 0x0A;
+		updateRAMMapping();
+	} else if (address < 0x4000) {
+		// full 7 bit ROM bank, 0 still acts as 1
+		rom_bank_ = val & 0x7F;
+		if (rom_bank_ == 0)
+			rom_bank_ = 1;
+		mmu_->mapROM1(rom_bank_);
+	} else if (address < 0x6000) {
+		ram_select_ = val & 0x0F;
+		updateRAMMapping();
+	} else {
+		// writing 0 then 1 copies the running clock into the readable registers
+		if (latch_ == 0x00 && val == 0x01 && has_rtc_)
+			getClockRegisters(rtc_latched_);
+		latch_ = val;
+	}
+}
+
+// RAM banks map straight in; with an RTC register selected the area goes
+// through readRAM/writeRAM instead.
+void MBC3::updateRAMMapping() {
+	if (ram_enable_ && ram_select_ <= 0x03)
+		mmu_->mapRAM(ram_select_);
+	else
+		mmu_->mapRAM(-1);
+}
+
+BYTE MBC3::readRAM(WORD) {
+	if (!ram_enable_ || !has_rtc_ || ram_select_ < 0x08 || ram_select_ > 0x0C)
+		return 0xFF;
+
+	return rtc_latched_[ram_select_ - 0x08];
+}
+
+void MBC3::writeRAM(WORD, BYTE val) {
+	if (!ram_enable_ || !has_rtc_ || ram_select_ < 0x08 || ram_select_ > 0x0C)
+		return;
+
+	setClockRegister(ram_select_ - 0x08, val);
+}
+
+// Bring rtc_clocks_ up to the emulator's current cycle count.
+void MBC3::syncClock() {
+	readClock(rtc_clocks_, rtc_carry_);
+	rtc_base_ = mmu_->getClocks();
+}
+
+void MBC3::readClock(uint64_t &clocks, bool &carry) {
+	const uint64_t CLOCKS_PER_DAY = (uint64_t)CLOCK_SPEED * 86400;
+	uint64_t now = mmu_->getClocks();
+
+	clocks = rtc_clocks_;
+	carry = rtc_carry_;
+	if (!rtc_halt_)
+		clocks += now - rtc_base_;
+
+	// the day counter is 9 bits; running past it sets the carry flag,
+	// which stays set until the game clears it
+	if (clocks >= CLOCKS_PER_DAY * 512) {
+		carry = true;
+		clocks %= CLOCKS_PER_DAY * 512;
+	}
+}
+
+void MBC3::getClockRegisters(BYTE regs[5]) {
+	syncClock();
+
+	uint64_t seconds = rtc_clocks_ / CLOCK_SPEED;
+	int days = (int)(seconds / 86400);
+	regs[0] = seconds % 60;
+	regs[1] = (seconds / 60) % 60;
+	regs[2] = (seconds / 3600) % 24;
+	regs[3] = days & 0xFF;
+	regs[4] = ((days >> 8) & 0x01) | (rtc_halt_ ? 0x40 : 0) | (rtc_carry_ ? 0x80 : 0);
+}
+
+// Write one register and rebuild the clock from the result. Writing the
+// seconds also resets the part of a second that has gone by.
+void MBC3::setClockRegister(int reg, BYTE val) {
+	BYTE regs[5];
+	getClockRegisters(regs);
+
+	uint64_t fraction = rtc_clocks_ % CLOCK_SPEED;
+	if (reg == 0)
+		fraction = 0;
+
+	switch (reg) {
+	case 0: regs[0] = val & 0x3F; break;
+	case 1: regs[1] = val & 0x3F; break;
+	case 2: regs[2] = val & 0x1F; break;
+	case 3: regs[3] = val; break;
+	case 4:
+		regs[4] = val & 0x01;
+		rtc_halt_ = (val & 0x40) != 0;
+		rtc_carry_ = (val & 0x80) != 0;
+		break;
+	}
+
+	uint64_t days = regs[3] | ((regs[4] & 0x01) << 8);
+	uint64_t seconds = ((days * 24 + regs[2]) * 60 + regs[1]) * 60 + regs[0];
+	rtc_clocks_ = seconds * CLOCK_SPEED + fraction;
+}
+
+// The usual 48 byte clock footer other emulators write: the running and
+// latched registers as 32 bit little endian words, then a 64 bit Unix time.
+int MBC3::getSaveDataSize() {
+	return has_rtc_ ? 48 : 0;
+}
+
+static uint64_t readLE(const BYTE *data, int bytes) {
+	uint64_t val = 0;
+	for (int i = bytes - 1; i >= 0; --i)
+		val = (val << 8) | data[i];
+	return val;
+}
+
+static void writeLE(BYTE *data, int bytes, uint64_t val) {
+	for (int i = 0; i < bytes; ++i) {
+		data[i] = val & 0xFF;
+		val >>= 8;
+	}
+}
+
+void MBC3::loadSaveData(const BYTE *data) {
+	if (!has_rtc_)
+		return;
+
+	for (int i = 0; i < 5; ++i) {
+		setClockRegister(i, (BYTE)readLE(&data[i * 4], 4));
+		rtc_latched_[i] = (BYTE)readLE(&data[20 + i * 4], 4);
+	}
+	saved_time_ = (int64_t)readLE(&data[40], 8);
+}
+
+void MBC3::storeSaveData(BYTE *data) {
+	if (!has_rtc_)
+		return;
+
+	BYTE regs[5];
+	getClockRegisters(regs);
+	for (int i = 0; i < 5; ++i) {
+		writeLE(&data[i * 4], 4, regs[i]);
+		writeLE(&data[20 + i * 4], 4, rtc_latched_[i]);
+	}
+	writeLE(&data[40], 8, (uint64_t)time(NULL));
+}
+
+void MBC3::catchUpClock() {
+	int64_t now = (int64_t)time(NULL);
+	if (!has_rtc_ || saved_time_ <= 0 || now <= saved_time_)
+		return;
+
+	syncClock();
+	if (!rtc_halt_)
+		rtc_clocks_ += (uint64_t)(now - saved_time_) * CLOCK_SPEED;
+	saved_time_ = 0;
+	syncClock();
+}
+
+// The clock is saved as it reads now and picks up from the emulator's
+// cycle count as it is after loading.
+void MBC3::saveState(StateWriter &w) {
+	w.putBool(ram_enable_);
+	w.put8(rom_bank_);
+	w.put8(ram_select_);
+	w.put8(latch_);
+
+	// leaves the clock alone, so saving (and so Emulator::fork()) doesn't
+	// change anything
+	uint64_t clocks;
+	bool carry;
+	readClock(clocks, carry);
+	w.put64(clocks);
+	w.putBool(rtc_halt_);
+	w.putBool(carry);
+	w.putBytes(rtc_latched_, 5);
+}
+
+void MBC3::loadState(StateReader &r) {
+	ram_enable_ = r.getBool();
+	rom_bank_ = r.get8();
+	ram_select_ = r.get8();
+	latch_ = r.get8();
+
+	rtc_clocks_ = r.get64();
+	rtc_base_ = mmu_->getClocks();
+	rtc_halt_ = r.getBool();
+	rtc_carry_ = r.getBool();
+	r.getBytes(rtc_latched_, 5);
+
+	mmu_->mapROM1(rom_bank_);
+	updateRAMMapping();
+}
+
+// ---------------------------------------------------------------------------
+// MBC5
+
+MBC5::MBC5(MMU *mmu) : MBC(mmu) {
+}
+
+void MBC5::reset() {
+	ram_enable_ = false;
+	rom_bank_ = 1;
+	ram_bank_ = 0;
+
+	mmu_->mapROM0(0);
+	mmu_->mapROM1(rom_bank_);
+	mmu_->mapRAM(-1);
+}
+
+void MBC5::writeROM(WORD address, BYTE val) {
+	if (address < 0x2000) {
+		ram_enable_ = (val & 0x0F) == 0x0A;
+	} else if (address < 0x3000) {
+		// low 8 bits of the ROM bank. Unlike the others, bank 0 is allowed.
+		rom_bank_ = (rom_bank_ & 0x100) | val;
+		mmu_->mapROM1(rom_bank_);
+	} else if (address < 0x4000) {
+		rom_bank_ = (rom_bank_ & 0xFF) | ((val & 0x01) << 8);
+		mmu_->mapROM1(rom_bank_);
+	} else if (address < 0x6000) {
+		ram_bank_ = val & 0x0F;
+	}
+
+	mmu_->mapRAM(ram_enable_ ? ram_bank_ : -1);
+}
+
+void MBC5::saveState(StateWriter &w) {
+	w.putBool(ram_enable_);
+	w.put16(rom_bank_);
+	w.put8(ram_bank_);
+}
+
+void MBC5::loadState(StateReader &r) {
+	ram_enable_ = r.getBool();
+	rom_bank_ = r.get16();
+	ram_bank_ = r.get8();
+
+	mmu_->mapROM1(rom_bank_);
+	mmu_->mapRAM(ram_enable_ ? ram_bank_ : -1);
+}
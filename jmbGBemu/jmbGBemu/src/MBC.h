@@ -0,0 +1,169 @@
+// MBC.h
+// Author: Jason Blanchard
+// Define the memory bank controllers found on cartridges. A controller
+// watches writes to the ROM area and tells the MMU which banks to map, so
+// bank switching just repoints the MMU's page table and ordinary reads never
+// have to ask which controller is fitted.
+
+#ifndef _MBC_H
+#define _MBC_H
+
+#include "definitions.h"
+#include "HeaderInfo.h"
+#include "SaveState.h"
+
+class MBC {
+public:
+	MBC(MMU *mmu);
+	virtual ~MBC();
+
+	// Make the right controller for the cartridge type in the header.
+	static MBC *create(HeaderInfo *hi, MMU *mmu);
+
+	// Size of cartridge RAM in bytes. Normally from the header, but MBC2
+	// has its RAM built in and the header says none.
+	static int getRamSize(HeaderInfo *hi);
+
+	// Whether the cartridge keeps its RAM alive with a battery, i.e. whether
+	// it should be saved between runs.
+	static bool hasBattery(HeaderInfo *hi);
+
+	// Map the power-on banks.
+	virtual void reset() = 0;
+
+	// Writes to 0x0000-0x7FFF, which go to the controller's registers.
+	virtual void writeROM(WORD address, BYTE val) = 0;
+
+	// Accesses to 0xA000-0xBFFF that aren't mapped straight to RAM (RAM
+	// disabled, RTC registers, MBC2's half-byte RAM).
+	virtual BYTE readRAM(WORD address);
+	virtual void writeRAM(WORD address, BYTE val);
+
+	// Extra battery-backed state kept after the RAM in the save file (the
+	// MBC3 clock). load is given zeros when there's no save yet.
+	virtual int getSaveDataSize();
+	virtual void loadSaveData(const BYTE *data);
+	virtual void storeSaveData(BYTE *data);
+
+	// Move a clock forward by the real time that passed since the save was
+	// written. Only done when asked, since it makes runs irreproducible.
+	virtual void catchUpClock();
+
+	// Save states. Loading also maps the banks the registers select.
+	virtual void saveState(StateWriter &w);
+	virtual void loadState(StateReader &r);
+
+protected:
+	MMU *mmu_;
+};
+
+// ROM only, possibly with up to 8 KB of RAM that is always enabled.
+class NoMBC : public MBC {
+public:
+	NoMBC(MMU *mmu);
+
+	void reset();
+	void writeROM(WORD address, BYTE val);
+};
+
+// MBC1: up to 2 MB ROM / 32 KB RAM, with a mode that swaps the upper two bank
+// bits between the ROM and RAM banks.
+class MBC1 : public MBC {
+public:
+	MBC1(MMU *mmu);
+
+	void reset();
+	void writeROM(WORD address, BYTE val);
+	void saveState(StateWriter &w);
+	void loadState(StateReader &r);
+
+private:
+	bool ram_enable_;
+	BYTE bank1_; // 5 bits, 0x2000-0x3FFF
+	BYTE bank2_; // 2 bits, 0x4000-0x5FFF
+	BYTE mode_;  // 0x6000-0x7FFF
+
+	void updateMapping();
+};
+
+// MBC2: up to 256 KB ROM, 512 x 4 bits of built-in RAM.
+class MBC2 : public MBC {
+public:
+	MBC2(MMU *mmu);
+
+	void reset();
+	void writeROM(WORD address, BYTE val);
+	BYTE readRAM(WORD address);
+	void writeRAM(WORD address, BYTE val);
+	void saveState(StateWriter &w);
+	void loadState(StateReader &r);
+
+private:
+	bool ram_enable_;
+	BYTE rom_bank_;
+};
+
+// MBC3: up to 2 MB ROM / 32 KB RAM, optionally with a real-time clock whose
+// registers are selected in place of a RAM bank.
+//
+// The clock is never ticked. It's kept as a count of emulated clocks as of
+// some point on the emulator's cycle counter and worked out from the
+// difference when it's looked at, so it runs with emulated time (and at
+// whatever speed the emulator does) and costs nothing in between.
+class MBC3 : public MBC {
+public:
+	MBC3(MMU *mmu, bool has_rtc);
+
+	void reset();
+	void writeROM(WORD address, BYTE val);
+	BYTE readRAM(WORD address);
+	void writeRAM(WORD address, BYTE val);
+
+	int getSaveDataSize();
+	void loadSaveData(const BYTE *data);
+	void storeSaveData(BYTE *data);
+	void catchUpClock();
+	void saveState(StateWriter &w);
+	void loadState(StateReader &r);
+
+private:
+	bool has_rtc_;
+	bool ram_enable_;
+	BYTE rom_bank_;
+	BYTE ram_select_; // 0x00-0x03 RAM bank, 0x08-0x0C RTC register
+	BYTE latch_;      // last value written to 0x6000-0x7FFF
+
+	uint64_t rtc_clocks_; // time on the clock, in emulated clocks
+	uint64_t rtc_base_;   // emulator cycle count rtc_clocks_ was taken at
+	bool rtc_halt_;
+	bool rtc_carry_;      // day counter overflowed
+	int64_t saved_time_;  // host time the save was written, 0 if none
+
+	// latched registers: seconds, minutes, hours, day low, day high/flags
+	BYTE rtc_latched_[5];
+
+	void updateRAMMapping();
+	void syncClock();
+	// the clock as syncClock() would leave it, without changing anything
+	void readClock(uint64_t &clocks, bool &carry);
+	void getClockRegisters(BYTE regs[5]);
+	void setClockRegister(int reg, BYTE val);
+};
+
+// MBC5: up to 8 MB ROM (9 bit bank number) / 128 KB RAM.
+class MBC5 : public MBC {
+public:
+	MBC5(MMU *mmu);
+
+	void reset();
+	void writeROM(WORD address, BYTE val);
+	void saveState(StateWriter &w);
+	void loadState(StateReader &r);
+
+private:
+	bool ram_enable_;
+	WORD rom_bank_;
+	BYTE ram_bank_;
+};
+
+#endif
@@ -6,17 +6,27 @@
 #define _MMU_H
 
 #include <string>
+#include <vector>
+#include <memory>
 #include <iostream>
 #include <fstream>
 #include <cstring> // for memcpy
-#include <SDL.h>
 
 #include "definitions.h"
 #include "HeaderInfo.h"
+#include "RomImage.h"
+#include "SaveState.h"
+#include "MemoryHeatmap.h"
 
 class MMU {
 public:
-	MMU(std::string filename, HeaderInfo *hi, Emulator *emu);
+	// battery_saves keeps battery-backed cartridge RAM in a .sav file next to
+	// the ROM; otherwise it only lives in memory for the length of the run.
+	MMU(std::string filename, HeaderInfo *hi, Emulator *emu, bool battery_saves = true);
+	// run a ROM image that is already loaded, sharing it with other instances
+	MMU(std::shared_ptr<const RomImage> rom, HeaderInfo *hi, Emulator *emu, bool battery_saves = false);
+	// headless copy for a forked emulator, see Emulator::fork()
+	MMU(const MMU &parent, HeaderInfo *hi, Emulator *emu);
 	~MMU();
 
 	void readByte(WORD address, BYTE &dest);
@@ -25,17 +35,72 @@ public:
 	void readWord(WORD address, WORD &dest);
 	void writeWord(WORD address, WORD val);
 
+	void updateDMA(int cycles);
 	void updateDiv();
 	void updateTima();
 	void updateLY();
 	void setLCDCMode(Mode m);
 	void setButtonPressed(Button b);
 	void setButtonReleased(Button b);
-
-	void renderScreen();
+	// all eight buttons at once, bit n for Button n
+	void setButtons(BYTE buttons);
+	BYTE getButtons();
+
+	// Used by the cartridge's MBC to switch banks. These only repoint the
+	// page table, so a switch costs the same however big the cartridge is.
+	void mapROM0(int bank);
+	void mapROM1(int bank);
+	void mapRAM(int bank);
+	BYTE *getCartRAM();
+	// ROM bank mapped at address, or -1 if address isn't in ROM. Inline, as
+	// tracing asks for every instruction.
+	int getROMBank(WORD address) {
+		if (address < 0x4000)
+			return curr_rom_bank_0_;
+		return address < 0x8000 ? curr_rom_bank_ : -1;
+	}
+
+#ifdef JMBGB_MEMORY_HEATMAP
+	// count every CPU access into heatmap (NULL stops counting)
+	void setHeatmap(MemoryHeatmap *heatmap);
+#endif
+
+	// whether cartridge RAM is a battery .sav file, rather than starting empty
+	bool hasSaveFile() const { return save_file_.isOpen(); }
+
+	// Schedule (or with sync, wait for) write back of the .sav file. Cartridge
+	// RAM is the mapped file itself, only the MBC's clock is copied in.
+	void flushSaveFile(bool sync);
+
+	// Advance the cartridge clock by the host time since it was saved.
+	void catchUpClock();
+	uint64_t getClocks();
+
+	void renderScanline();
+	const BYTE *getFrameBuffer();
+	// Draw into buffer (160x144) instead, so a caller can have frames land
+	// where it wants them without copying. The current frame is copied over
+	// once. NULL copies it back into the MMU's own buffer and uses that
+	// again; do that before buffer goes away, as the MMU keeps drawing into
+	// it until then.
+	void setFrameBuffer(BYTE *buffer);
+	// Replace the picture shown so far, e.g. with the one that went with a
+	// save state (frames aren't part of one).
+	void setFrame(const BYTE *frame);
+
+	// Read memory the way a debugger would: no side effects, and what's really
+	// there even while OAM DMA has the bus.
+	BYTE peekByte(WORD address);
+	// WRAM (C000-DFFF, 8 KB) and HRAM plus IE (FF80-FFFF, 128 bytes)
+	void copyRAM(BYTE *work_ram, BYTE *high_ram);
 
 	void test(); // will be responsible for testing
 
+	// Memory, registers and cartridge state. Loading fails (returns false)
+	// if the state was made with a different size of cartridge RAM.
+	void saveState(StateWriter &w);
+	bool loadState(StateReader &r);
+
 	// direct access to Interrupt Master Enable flag
 	bool ime_;
 
@@ -46,9 +111,7 @@ private:
 	// ---------------------------- FFFF
 	// Stack RAM
 	// ---------------------------- FF80
-	// Empty unusable
-	// ---------------------------- FF4C
-	// I/O Ports
+	// I/O Ports (FF4C-FF7F unused)
 	// ---------------------------- FF00
 	// Empty unusable
 	// ---------------------------- FEA0
@@ -68,24 +131,52 @@ private:
 	// ---------------------------- 0000
 
 	// note, remember to only access size - 1 (e.g. 0x0000-0x3FFF)
-	BYTE rom_bank_0_[0x4000];
-	BYTE switchable_rom_bank_[128][0x4000];
+	// ROM lives in a shared read-only image, cartridge RAM is sized to what the
+	// cartridge header declares. The bank pointers point at the currently
+	// mapped 16 KB ROM bank and 8 KB RAM bank.
+	std::shared_ptr<const RomImage> rom_;
+	const BYTE *rom_bank_0_;
+	const BYTE *rom_bank_;
+	BYTE *cart_ram_;
+	size_t cart_ram_size_;
+	std::vector<BYTE> cart_ram_storage_; // cartridge RAM when it isn't saved
+	MappedFile save_file_;               // cartridge RAM when it is
+	BYTE *save_data_;                    // MBC state saved after the RAM, or NULL
+	bool battery_saves_;
+	BYTE *ram_bank_;
 	BYTE video_ram_[0x2000];
-	BYTE switchable_ram_bank_[4][0x2000];
 	BYTE internal_ram_[0x2000];
-	BYTE echo_internal_ram_[0x1E00];
 	BYTE oam_[0xA0];
-	BYTE io_ports_[0x4C];
+	BYTE io_ports_[0x80];
 	BYTE stack_ram_[0x7F];
 	BYTE interrupt_enable_register_;
 
+	// Page table, one entry per 4 KB of the address space. A non-null entry
+	// points at the memory backing that page; null means the page needs
+	// special handling (MBC registers, unmapped cartridge RAM, I/O).
+	// read_map_ is what the CPU sees, page_map_ what is really mapped; they
+	// only differ while OAM DMA points the CPU's reads at open_bus_.
+	const BYTE *read_map_[16];
+	const BYTE *page_map_[16];
+	BYTE *write_map_[16];
+	BYTE open_bus_[0x1000];
+
+	// OAM DMA in progress, clocks until it completes
+	WORD dma_source_;
+	int dma_clocks_;
+
+#ifdef JMBGB_MEMORY_HEATMAP
+	MemoryHeatmap *heatmap_;
+#endif
+
 	Emulator *emu_;
 	HeaderInfo *hi_;
+	MBC *mbc_;
 	int num_rom_banks_;
+	int curr_rom_bank_0_;
 	int curr_rom_bank_;
 	int num_ram_banks_;
 	int curr_ram_bank_;
-	bool ram_enable_;
 
 	// Whether or not any of the joypad keys are pressed
 	bool right_pressed_;
@@ -97,22 +188,47 @@ private:
 	bool start_pressed_;
 	bool select_pressed_;
 
-	// SDL screen
-	SDL_Surface *screen;
-	Uint32 COLOR_WHITE;
-	Uint32 COLOR_LGREY;
-	Uint32 COLOR_DGREY;
-	Uint32 COLOR_BLACK;
-
-	Uint32 bg_data_[256][256];
-	bool recalc_bg_data_;
+	// the frame being drawn, one line at a time, as shade numbers (0-3) after
+	// BGP/OBP0/OBP1. Turning shades into colours is up to the frontend.
+	// Normally points at own_frame_, see setFrameBuffer().
+	BYTE (*frame_)[160];
+	BYTE own_frame_[144][160];
+	// internal line counter of the window, only advances on lines it is drawn
+	BYTE window_line_;
 
 	// timer
 	bool timer_running_;
 	BYTE timer_clock_select_;
 
+	// I/O registers (0xFF00-0xFF7F). Each register can have a read and a
+	// write handler; the rest are plain memory.
+	typedef BYTE (MMU::*io_read_fn)(BYTE reg);
+	typedef void (MMU::*io_write_fn)(BYTE reg, BYTE val);
+	static io_read_fn io_read_[];
+	static io_write_fn io_write_[];
+
+	BYTE readIO(BYTE reg);
+	void writeIO(BYTE reg, BYTE val);
+	BYTE readJOYP(BYTE reg);
+	void writeJOYP(BYTE reg, BYTE val);
+	void writeDIV(BYTE reg, BYTE val);
+	void writeTIMA(BYTE reg, BYTE val);
+	void writeTAC(BYTE reg, BYTE val);
+	void writeSTAT(BYTE reg, BYTE val);
+	void writeLY(BYTE reg, BYTE val);
+	void writeDMA(BYTE reg, BYTE val);
+	BYTE readUnused(BYTE reg);
+	void writeUnused(BYTE reg, BYTE val);
+
+	void init();
 	void loadROM(std::string filename);
-	void loadBGMapData(int mapSelect, int dataSelect);
+	void mapROM();
+	void mapCartridge();
+	void allocCartRAM(size_t size, size_t extra);
+	void mapReadPage(int page, const BYTE *mem);
+	void renderTileRow(BYTE *dest, int start, WORD map_row, BYTE scroll_x, int tile_y,
+		bool unsigned_data);
+	void renderSprites(BYTE ly, const BYTE *bg_color, BYTE *row);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,360 @@
+// MappedFile.cpp
+// Author: Jason Blanchard
+// Implement MappedFile class, a thin wrapper over mapping a file into memory
+// (mmap on POSIX systems, file mappings on Windows).
+
+#include "MappedFile.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+MappedFile::MappedFile() {
+	data_ = NULL;
+	size_ = 0;
+	writable_ = false;
+	shared_ = false;
+#ifdef _WIN32
+	file_ = INVALID_HANDLE_VALUE;
+	mapping_ = NULL;
+#else
+	fd_ = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::openReadOnly(const std::string &filename) {
+	close();
+
+	file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_ == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (GetFileType(file_) != FILE_TYPE_DISK || !GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_ == NULL) {
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (data_ == NULL) {
+		close();
+		return false;
+	}
+
+	size_ = (size_t)size.QuadPart;
+	return true;
+}
+
+bool MappedFile::openReadWrite(const std::string &filename, size_t size) {
+	close();
+
+	file_ = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_ == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER current;
+	if (!GetFileSizeEx(file_, &current)) {
+		close();
+		return false;
+	}
+
+	// asking for a mapping bigger than the file grows it, zero filled
+	LARGE_INTEGER map_size;
+	map_size.QuadPart = current.QuadPart > (LONGLONG)size ? current.QuadPart : (LONGLONG)size;
+	mapping_ = CreateFileMappingA(file_, NULL, PAGE_READWRITE, map_size.HighPart, map_size.LowPart, NULL);
+	if (mapping_ == NULL) {
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, size);
+	if (data_ == NULL) {
+		close();
+		return false;
+	}
+
+	size_ = size;
+	writable_ = true;
+	return true;
+}
+
+bool MappedFile::createShared(const std::string &name, size_t size) {
+	close();
+
+	if (size == 0)
+		return false;
+
+	// backed by the page file rather than a file of our own
+	uint64_t size64 = size;
+	mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(size64 >> 32), (DWORD)size64, name.c_str());
+	if (mapping_ == NULL) {
+		close();
+		return false;
+	}
+
+	// an old mapping can't be replaced while someone still has it open, and
+	// may not even be the right size
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		EMULOG_ERROR("Shared memory %s is already in use by another process.", name);
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, size);
+	if (data_ == NULL) {
+		close();
+		return false;
+	}
+
+	size_ = size;
+	writable_ = true;
+	shared_ = true;
+	shared_name_ = name;
+	return true;
+}
+
+bool MappedFile::openShared(const std::string &name) {
+	close();
+
+	mapping_ = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	if (mapping_ == NULL)
+		return false;
+
+	data_ = (BYTE *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (data_ == NULL) {
+		close();
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	if (VirtualQuery(data_, &info, sizeof(info)) == 0) {
+		close();
+		return false;
+	}
+
+	size_ = info.RegionSize;
+	shared_ = true;
+	return true;
+}
+
+void MappedFile::flush(bool sync) {
+	if (!data_ || !writable_ || shared_)
+		return;
+
+	FlushViewOfFile(data_, size_);
+	if (sync)
+		FlushFileBuffers(file_);
+}
+
+void MappedFile::close() {
+	if (data_ && writable_)
+		flush(true);
+	if (data_)
+		UnmapViewOfFile(data_);
+	if (mapping_)
+		CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_);
+
+	data_ = NULL;
+	size_ = 0;
+	writable_ = false;
+	shared_ = false;
+	shared_name_.clear();
+	mapping_ = NULL;
+	file_ = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::adviseWillNeed(size_t offset, size_t length) { }
+
+void MappedFile::adviseRandom() { }
+
+#else
+
+bool MappedFile::openReadOnly(const std::string &filename) {
+	close();
+
+	fd_ = open(filename.c_str(), O_RDONLY);
+	if (fd_ < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close();
+		return false;
+	}
+
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)data;
+	size_ = (size_t)st.st_size;
+	return true;
+}
+
+bool MappedFile::openReadWrite(const std::string &filename, size_t size) {
+	close();
+
+	if (size == 0)
+		return false;
+
+	fd_ = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd_ < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close();
+		return false;
+	}
+
+	if ((size_t)st.st_size < size && ftruncate(fd_, (off_t)size) != 0) {
+		close();
+		return false;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)data;
+	size_ = size;
+	writable_ = true;
+	return true;
+}
+
+// shm_open wants names like /name
+static std::string getSharedPath(const std::string &name) {
+	return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+bool MappedFile::createShared(const std::string &name, size_t size) {
+	close();
+
+	if (size == 0)
+		return false;
+
+	// never take over a name someone else is exporting to. One left by a
+	// process that crashed has to be removed by hand.
+	std::string path = getSharedPath(name);
+	fd_ = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd_ < 0) {
+		if (errno == EEXIST)
+			EMULOG_ERROR("Shared memory %s is already in use (if nothing is using it, remove /dev/shm%s).",
+				name, path);
+		return false;
+	}
+	shared_name_ = path;
+
+	if (ftruncate(fd_, (off_t)size) != 0) {
+		close();
+		return false;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)data;
+	size_ = size;
+	writable_ = true;
+	shared_ = true;
+	return true;
+}
+
+bool MappedFile::openShared(const std::string &name) {
+	close();
+
+	fd_ = shm_open(getSharedPath(name).c_str(), O_RDONLY, 0);
+	if (fd_ < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+		close();
+		return false;
+	}
+
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+	if (data == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	data_ = (BYTE *)data;
+	size_ = (size_t)st.st_size;
+	shared_ = true;
+	return true;
+}
+
+void MappedFile::flush(bool sync) {
+	if (data_ && writable_ && !shared_)
+		msync(data_, size_, sync ? MS_SYNC : MS_ASYNC);
+}
+
+void MappedFile::close() {
+	if (data_ && writable_)
+		flush(true);
+	if (data_)
+		munmap(data_, size_);
+	if (fd_ >= 0)
+		::close(fd_);
+	if (!shared_name_.empty())
+		shm_unlink(shared_name_.c_str());
+
+	data_ = NULL;
+	size_ = 0;
+	writable_ = false;
+	shared_ = false;
+	shared_name_.clear();
+	fd_ = -1;
+}
+
+void MappedFile::adviseWillNeed(size_t offset, size_t length) {
+	if (!data_ || offset >= size_)
+		return;
+
+	// madvise wants a page aligned start
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = offset - offset % page;
+	if (length > size_ - offset)
+		length = size_ - offset;
+
+	madvise(data_ + start, length + (offset - start), MADV_WILLNEED);
+}
+
+void MappedFile::adviseRandom() {
+	if (data_)
+		madvise(data_, size_, MADV_RANDOM);
+}
+
+#endif
@@ -0,0 +1,70 @@
+// MappedFile.h
+// Author: Jason Blanchard
+// Define MappedFile class, a thin wrapper over mapping a file into memory
+// (mmap on POSIX systems, file mappings on Windows). It can also map named
+// shared memory, for handing data to other processes.
+
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+#include "definitions.h"
+
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Map an existing regular file read-only. Fails for empty files and
+	// anything that isn't a regular file (pipes, devices).
+	bool openReadOnly(const std::string &filename);
+
+	// Map a file read-write and shared, so stores go straight to the file
+	// through the page cache. The file is created, or extended with zeros,
+	// if it is shorter than size. A longer file is left as it is and only
+	// the first size bytes are mapped.
+	bool openReadWrite(const std::string &filename, size_t size);
+
+	// Create a named block of shared memory, zero filled. Fails if the name
+	// is already in use. The name goes away when it's closed, though
+	// processes that already have it open keep their mapping.
+	bool createShared(const std::string &name, size_t size);
+
+	// Map shared memory another process created, read-only.
+	bool openShared(const std::string &name);
+
+	// Push dirty pages towards the disk. sync waits until they are written.
+	void flush(bool sync);
+	void close();
+
+	// Paging hints. These are only hints, so they quietly do nothing where
+	// the platform has no equivalent.
+	void adviseWillNeed(size_t offset, size_t length);
+	void adviseRandom();
+
+	bool isOpen() const { return data_ != NULL; }
+	const BYTE *getData() const { return data_; }
+	BYTE *getData() { return data_; }
+	size_t getSize() const { return size_; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	BYTE *data_;
+	size_t size_;
+	bool writable_;
+	bool shared_;
+	std::string shared_name_; // set when we created it
+
+#ifdef _WIN32
+	void *file_;
+	void *mapping_;
+#else
+	int fd_;
+#endif
+};
+
+#endif
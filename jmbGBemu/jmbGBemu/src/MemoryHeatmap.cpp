@@ -0,0 +1,224 @@
+// MemoryHeatmap.cpp
+// Author: Jason Blanchard
+// Implement MemoryHeatmap class, which counts memory accesses and writes them
+// out as CSV or as a PNG picture.
+
+#include "MemoryHeatmap.h"
+#include "Log.h"
+
+#include <array>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+const int HEATMAP_WIDTH = 512;
+const int HEATMAP_BUS_ROWS = 256;
+const int HEATMAP_BANK_ROWS = 64;
+
+MemoryHeatmap::MemoryHeatmap() {
+	memset(reads_, 0, sizeof(reads_));
+	memset(writes_, 0, sizeof(writes_));
+}
+
+MemoryHeatmap::~MemoryHeatmap() {
+	for (size_t i = 0; i < bank_reads_.size(); ++i)
+		delete[] bank_reads_[i];
+}
+
+void MemoryHeatmap::addBank(int bank) {
+	if (bank >= (int)bank_reads_.size())
+		bank_reads_.resize(bank + 1, NULL);
+	bank_reads_[bank] = new uint64_t[0x4000];
+	memset(bank_reads_[bank], 0, 0x4000 * sizeof(uint64_t));
+}
+
+// Upper case hex, zero padded to digits.
+static std::string hex(unsigned val, int digits) {
+	char text[16];
+	snprintf(text, sizeof(text), "%0*X", digits, val);
+	return text;
+}
+
+// One row per address that was touched: "bus" rows for the address space as
+// the CPU saw it, then "rom" rows for each bank, keyed by where the bank is
+// mapped (bank 0 at 0000, the rest at 4000). ROM is only ever read.
+bool MemoryHeatmap::writeCSV(const std::string &filename) {
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't write heatmap %s", filename);
+		return false;
+	}
+
+	file << "space,bank,address,reads,writes\n";
+	for (int i = 0; i < 0x10000; ++i) {
+		if (reads_[i] != 0 || writes_[i] != 0)
+			file << "bus,," << hex(i, 4) << ',' << reads_[i] << ',' << writes_[i] << '\n';
+	}
+	for (size_t bank = 0; bank < bank_reads_.size(); ++bank) {
+		if (bank_reads_[bank] == NULL)
+			continue;
+		WORD base = bank == 0 ? 0x0000 : 0x4000;
+		for (int i = 0; i < 0x4000; ++i) {
+			if (bank_reads_[bank][i] != 0)
+				file << "rom," << hex((unsigned)bank, 2) << ',' << hex(base + i, 4) << ','
+					<< bank_reads_[bank][i] << ",0\n";
+		}
+	}
+
+	return file.good();
+}
+
+// "hot" colours: black, red, yellow, white. Counts are scaled by their log so
+// a loop's millions of reads don't wash out everything that ran once.
+static void heatColour(uint64_t count, double log_max, BYTE *rgb) {
+	if (count == 0) {
+		rgb[0] = rgb[1] = rgb[2] = 0;
+		return;
+	}
+	double t = log_max > 0 ? std::log((double)count + 1) / log_max : 1.0;
+	// anything touched at all should show up
+	t = 0.1 + 0.9 * t;
+	double c[3] = { 3 * t, 3 * t - 1, 3 * t - 2 };
+	for (int i = 0; i < 3; ++i) {
+		if (c[i] < 0)
+			c[i] = 0;
+		if (c[i] > 1)
+			c[i] = 1;
+		rgb[i] = (BYTE)(c[i] * 255 + 0.5);
+	}
+}
+
+static uint32_t crc32(uint32_t crc, const BYTE *data, size_t size) {
+	// built the first time through; several emulators can be writing PNGs at
+	// once, and a local static is only ever initialised by one of them
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> t;
+		for (uint32_t n = 0; n < 256; ++n) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			t[n] = c;
+		}
+		return t;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBE32(std::vector<BYTE> &out, uint32_t val) {
+	out.push_back((BYTE)(val >> 24));
+	out.push_back((BYTE)(val >> 16));
+	out.push_back((BYTE)(val >> 8));
+	out.push_back((BYTE)val);
+}
+
+static void putChunk(std::vector<BYTE> &out, const char *type, const std::vector<BYTE> &data) {
+	putBE32(out, (uint32_t)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	putBE32(out, crc32(0, &out[start], out.size() - start));
+}
+
+// zlib stream of stored (uncompressed) deflate blocks. The picture is a few
+// hundred KB at most, so there's no need to pull in a compressor for it.
+static void storeZlib(const std::vector<BYTE> &raw, std::vector<BYTE> &out) {
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	size_t pos = 0;
+	do {
+		size_t len = raw.size() - pos < 0xFFFF ? raw.size() - pos : 0xFFFF;
+		out.push_back(pos + len == raw.size() ? 1 : 0); // last block?
+		out.push_back((BYTE)len);
+		out.push_back((BYTE)(len >> 8));
+		out.push_back((BYTE)~len);
+		out.push_back((BYTE)(~len >> 8));
+		out.insert(out.end(), raw.begin() + pos, raw.begin() + pos + len);
+		pos += len;
+	} while (pos < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); ++i) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBE32(out, (b << 16) | a);
+}
+
+bool MemoryHeatmap::writePNG(const std::string &filename) {
+	std::vector<int> banks;
+	for (size_t bank = 0; bank < bank_reads_.size(); ++bank) {
+		if (bank_reads_[bank] != NULL)
+			banks.push_back((int)bank);
+	}
+	int height = HEATMAP_BUS_ROWS + HEATMAP_BANK_ROWS * (int)banks.size();
+
+	// reads and writes share a scale so the two halves compare; the banks get
+	// their own, since ROM reads are most of what the CPU does
+	uint64_t bus_max = 0, bank_max = 0;
+	for (int i = 0; i < 0x10000; ++i) {
+		if (reads_[i] > bus_max)
+			bus_max = reads_[i];
+		if (writes_[i] > bus_max)
+			bus_max = writes_[i];
+	}
+	for (size_t b = 0; b < banks.size(); ++b) {
+		for (int i = 0; i < 0x4000; ++i) {
+			if (bank_reads_[banks[b]][i] > bank_max)
+				bank_max = bank_reads_[banks[b]][i];
+		}
+	}
+	double log_bus_max = std::log((double)bus_max + 1);
+	double log_bank_max = std::log((double)bank_max + 1);
+
+	// each row is a filter byte (0, none) then RGB pixels
+	size_t stride = 1 + HEATMAP_WIDTH * 3;
+	std::vector<BYTE> raw(stride * height, 0);
+	for (int y = 0; y < HEATMAP_BUS_ROWS; ++y) {
+		BYTE *row = &raw[stride * y + 1];
+		for (int x = 0; x < 256; ++x) {
+			heatColour(reads_[y * 256 + x], log_bus_max, &row[x * 3]);
+			heatColour(writes_[y * 256 + x], log_bus_max, &row[(256 + x) * 3]);
+		}
+	}
+	for (size_t b = 0; b < banks.size(); ++b) {
+		const uint64_t *counts = bank_reads_[banks[b]];
+		for (int y = 0; y < HEATMAP_BANK_ROWS; ++y) {
+			BYTE *row = &raw[stride * (HEATMAP_BUS_ROWS + HEATMAP_BANK_ROWS * b + y) + 1];
+			for (int x = 0; x < 256; ++x)
+				heatColour(counts[y * 256 + x], log_bank_max, &row[x * 3]);
+		}
+	}
+
+	std::vector<BYTE> png;
+	const BYTE signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	png.insert(png.end(), signature, signature + 8);
+
+	std::vector<BYTE> header;
+	putBE32(header, HEATMAP_WIDTH);
+	putBE32(header, height);
+	header.push_back(8); // bits per channel
+	header.push_back(2); // RGB
+	header.push_back(0); // compression, filter, interlace
+	header.push_back(0);
+	header.push_back(0);
+	putChunk(png, "IHDR", header);
+
+	std::vector<BYTE> data;
+	storeZlib(raw, data);
+	putChunk(png, "IDAT", data);
+	putChunk(png, "IEND", std::vector<BYTE>());
+
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't write heatmap %s", filename);
+		return false;
+	}
+	file.write((const char *)&png[0], png.size());
+	return file.good();
+}
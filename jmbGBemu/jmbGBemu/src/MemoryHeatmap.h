@@ -0,0 +1,58 @@
+// MemoryHeatmap.h
+// Author: Jason Blanchard
+// Define MemoryHeatmap class, which counts the CPU's reads and writes at
+// every address, and its reads from every ROM bank, to show which parts of
+// memory games actually spend their time in.
+//
+// The MMU only feeds it when built with JMBGB_MEMORY_HEATMAP defined;
+// without it readByte() and friends are exactly as they were and
+// Emulator::recordHeatmap() just reports that it isn't available.
+
+#ifndef _MEMORYHEATMAP_H
+#define _MEMORYHEATMAP_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "definitions.h"
+
+class MemoryHeatmap {
+public:
+	MemoryHeatmap();
+	~MemoryHeatmap();
+
+	// bank is the ROM bank mapped at address, -1 outside ROM
+	void countRead(WORD address, int bank) {
+		++reads_[address];
+		if (bank >= 0)
+			++getBank(bank)[address & 0x3FFF];
+	}
+	void countWrite(WORD address) {
+		++writes_[address];
+	}
+
+	// Every address with any accesses, as CSV.
+	bool writeCSV(const std::string &filename);
+	// The address space as a picture, one pixel per address and 256 to a
+	// row: reads on the left, writes on the right, and below them a 256x64
+	// strip of reads for each ROM bank used. Brighter is busier, on a log
+	// scale.
+	bool writePNG(const std::string &filename);
+
+private:
+	uint64_t reads_[0x10000];
+	uint64_t writes_[0x10000];
+
+	// reads per 16 KB ROM bank, made when the bank is first read
+	std::vector<uint64_t *> bank_reads_;
+
+	uint64_t *getBank(int bank) {
+		if (bank >= (int)bank_reads_.size() || bank_reads_[bank] == NULL)
+			addBank(bank);
+		return bank_reads_[bank];
+	}
+	void addBank(int bank);
+};
+
+#endif
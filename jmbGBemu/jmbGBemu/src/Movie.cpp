@@ -0,0 +1,145 @@
+// Movie.cpp
+// Author: Jason Blanchard
+// Implement MovieRecorder and MoviePlayer, recording joypad input and playing
+// it back frame for frame.
+
+#include "Movie.h"
+#include "Log.h"
+
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+
+static void write32(std::ofstream &file, uint32_t val) {
+	char bytes[4];
+	for (int i = 0; i < 4; ++i)
+		bytes[i] = (char)((val >> (i * 8)) & 0xFF);
+	file.write(bytes, 4);
+}
+
+static uint32_t read32(const BYTE *data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// ---------------------------------------------------------------------------
+// MovieRecorder
+
+MovieRecorder::MovieRecorder() {
+	last_buttons_ = 0;
+	last_frame_ = 0;
+}
+
+MovieRecorder::~MovieRecorder() {
+	close();
+}
+
+bool MovieRecorder::open(std::string filename, const char game_name[16]) {
+	close();
+
+	file_.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file_.is_open()) {
+		EMULOG_ERROR("Couldn't create movie %s", filename);
+		return false;
+	}
+
+	write32(file_, MOVIE_MAGIC);
+	write32(file_, MOVIE_VERSION);
+	file_.write(game_name, 16);
+	last_buttons_ = 0;
+	last_frame_ = 0;
+	return true;
+}
+
+// The last record marks where the movie ends, so playback knows how long
+// the buttons were held after the final change.
+void MovieRecorder::close() {
+	if (!file_.is_open())
+		return;
+
+	write32(file_, (uint32_t)(last_frame_ + 1));
+	file_.put(0);
+	file_.close();
+}
+
+void MovieRecorder::record(uint64_t frame, BYTE buttons) {
+	if (!file_.is_open())
+		return;
+
+	last_frame_ = frame;
+	if (buttons == last_buttons_)
+		return;
+
+	write32(file_, (uint32_t)frame);
+	file_.put((char)buttons);
+	last_buttons_ = buttons;
+}
+
+// ---------------------------------------------------------------------------
+// MoviePlayer
+
+MoviePlayer::MoviePlayer() {
+	next_ = 0;
+	buttons_ = 0;
+	end_frame_ = 0;
+	finished_ = true;
+}
+
+bool MoviePlayer::load(std::string filename, const char game_name[16]) {
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't open movie %s", filename);
+		return false;
+	}
+
+	std::vector<BYTE> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (data.size() < 24 || read32(&data[0]) != MOVIE_MAGIC) {
+		EMULOG_ERROR("%s isn't a movie.", filename);
+		return false;
+	}
+	if (read32(&data[4]) != MOVIE_VERSION) {
+		EMULOG_ERROR("Movie version %u isn't supported (expected %u).", read32(&data[4]), MOVIE_VERSION);
+		return false;
+	}
+	if (memcmp(&data[8], game_name, 16) != 0)
+		EMULOG_WARNING("Movie was recorded with a different game, playing it anyway.");
+
+	records_.clear();
+	for (size_t pos = 24; pos + 5 <= data.size(); pos += 5) {
+		Record r;
+		r.frame = read32(&data[pos]);
+		r.buttons = data[pos + 4];
+		records_.push_back(r);
+	}
+
+	next_ = 0;
+	buttons_ = 0;
+	end_frame_ = records_.empty() ? 0 : records_.back().frame;
+	finished_ = records_.empty();
+	return true;
+}
+
+// Frames are asked for in order, so this normally just walks forward.
+// Loading a state or rewinding sends the frame back, so then it finds its
+// place again.
+BYTE MoviePlayer::getButtons(uint64_t frame) {
+	if (next_ > 0 && records_[next_ - 1].frame > frame) {
+		// first record after frame
+		next_ = std::upper_bound(records_.begin(), records_.end(), frame,
+			[](uint64_t f, const Record &r) { return f < r.frame; }) - records_.begin();
+		buttons_ = next_ > 0 ? records_[next_ - 1].buttons : 0;
+	}
+
+	while (next_ < records_.size() && records_[next_].frame <= frame) {
+		buttons_ = records_[next_].buttons;
+		++next_;
+	}
+
+	if (frame >= end_frame_)
+		finished_ = true;
+
+	return buttons_;
+}
+
+bool MoviePlayer::isFinished() {
+	return finished_;
+}
@@ -0,0 +1,71 @@
+// Movie.h
+// Author: Jason Blanchard
+// Define MovieRecorder and MoviePlayer, which save the joypad input of a run
+// and feed it back in later. A movie starts at power on and is a list of
+// (frame, buttons) records, one each time the buttons change.
+//
+// Only the input is kept. A game with a battery save plays back the same
+// only if it starts from the same .sav file as when it was recorded.
+//
+// File layout, little endian: "JMBM", format version (32 bits), the game name
+// from the header (16 bytes), then 5 byte records: frame (32 bits), buttons.
+
+#ifndef _MOVIE_H
+#define _MOVIE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "definitions.h"
+#include "InputSource.h"
+
+const uint32_t MOVIE_MAGIC = 0x4D424D4A; // "JMBM"
+const uint32_t MOVIE_VERSION = 1;
+
+class MovieRecorder {
+public:
+	MovieRecorder();
+	~MovieRecorder();
+
+	bool open(std::string filename, const char game_name[16]);
+	void close();
+	bool isOpen() const { return file_.is_open(); }
+
+	// Called with the buttons used for every frame, in order. Only changes
+	// are written.
+	void record(uint64_t frame, BYTE buttons);
+
+private:
+	std::ofstream file_;
+	BYTE last_buttons_;
+	uint64_t last_frame_;
+};
+
+class MoviePlayer : public InputSource {
+public:
+	MoviePlayer();
+
+	// Reads the whole movie in. Warns, but still plays, if it was recorded
+	// with a different game.
+	bool load(std::string filename, const char game_name[16]);
+
+	// Goes back to the right place when a loaded state or rewind takes the
+	// frame count backwards.
+	BYTE getButtons(uint64_t frame);
+	bool isFinished();
+
+private:
+	struct Record {
+		uint32_t frame;
+		BYTE buttons;
+	};
+
+	std::vector<Record> records_;
+	size_t next_;       // first record not reached yet
+	BYTE buttons_;      // buttons as of the last record reached
+	uint64_t end_frame_; // frame the movie ends on
+	bool finished_;
+};
+
+#endif
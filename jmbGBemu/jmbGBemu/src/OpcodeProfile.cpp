@@ -0,0 +1,146 @@
+// OpcodeProfile.cpp
+// Author: Jason Blanchard
+// Implement OpcodeProfile class, which counts the instructions the CPU runs
+// and writes the counts out as CSV or JSON.
+
+#include "OpcodeProfile.h"
+#include "Log.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+OpcodeProfile::OpcodeProfile() {
+	memset(opcodes_, 0, sizeof(opcodes_));
+	memset(cb_opcodes_, 0, sizeof(cb_opcodes_));
+	memset(ram_hits_, 0, sizeof(ram_hits_));
+}
+
+OpcodeProfile::~OpcodeProfile() {
+	for (size_t i = 0; i < bank_hits_.size(); ++i)
+		delete[] bank_hits_[i];
+}
+
+void OpcodeProfile::addBank(int bank) {
+	if (bank >= (int)bank_hits_.size())
+		bank_hits_.resize(bank + 1, NULL);
+	bank_hits_[bank] = new Hits[0x4000];
+	memset(bank_hits_[bank], 0, 0x4000 * sizeof(Hits));
+}
+
+bool OpcodeProfile::write(const std::string &filename) {
+	size_t dot = filename.rfind('.');
+	if (dot != std::string::npos && filename.compare(dot, std::string::npos, ".json") == 0)
+		return writeJSON(filename);
+	return writeCSV(filename);
+}
+
+// Upper case hex, zero padded to digits.
+static std::string hex(unsigned val, int digits) {
+	char text[16];
+	snprintf(text, sizeof(text), "%0*X", digits, val);
+	return text;
+}
+
+// One table: opcode rows ("op" and "cb") with a cycle histogram, then a row
+// per instruction address that ran ("pc"), keyed bank:address. Addresses
+// outside ROM have no bank.
+bool OpcodeProfile::writeCSV(const std::string &filename) {
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't write opcode profile %s", filename);
+		return false;
+	}
+
+	file << "kind,key,count,cycles";
+	for (int b = 0; b < PROFILE_CYCLE_BUCKETS; ++b)
+		file << ",c" << b * 4;
+	file << '\n';
+
+	for (int table = 0; table < 2; ++table) {
+		const Entry *entries = table ? cb_opcodes_ : opcodes_;
+		for (int op = 0; op < 256; ++op) {
+			const Entry &e = entries[op];
+			if (e.count == 0)
+				continue;
+			file << (table ? "cb," : "op,") << hex(op, 2) << ',' << e.count << ',' << e.cycles;
+			for (int b = 0; b < PROFILE_CYCLE_BUCKETS; ++b)
+				file << ',' << e.histogram[b];
+			file << '\n';
+		}
+	}
+
+	for (size_t bank = 0; bank < bank_hits_.size(); ++bank) {
+		if (bank_hits_[bank] == NULL)
+			continue;
+		WORD base = bank == 0 ? 0x0000 : 0x4000;
+		for (int i = 0; i < 0x4000; ++i) {
+			const Hits &h = bank_hits_[bank][i];
+			if (h.count != 0)
+				file << "pc," << hex((unsigned)bank, 2) << ':' << hex(base + i, 4) << ','
+					<< h.count << ',' << h.cycles << '\n';
+		}
+	}
+	for (int i = 0; i < 0x8000; ++i) {
+		if (ram_hits_[i].count != 0)
+			file << "pc," << hex(0x8000 + i, 4) << ',' << ram_hits_[i].count << ','
+				<< ram_hits_[i].cycles << '\n';
+	}
+
+	return file.good();
+}
+
+bool OpcodeProfile::writeJSON(const std::string &filename) {
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) {
+		EMULOG_ERROR("Couldn't write opcode profile %s", filename);
+		return false;
+	}
+
+	file << "{\n";
+	for (int table = 0; table < 2; ++table) {
+		const Entry *entries = table ? cb_opcodes_ : opcodes_;
+		file << "  \"" << (table ? "cb_opcodes" : "opcodes") << "\": [";
+		const char *sep = "\n";
+		for (int op = 0; op < 256; ++op) {
+			const Entry &e = entries[op];
+			if (e.count == 0)
+				continue;
+			file << sep << "    {\"opcode\": " << op << ", \"count\": " << e.count
+				<< ", \"cycles\": " << e.cycles << ", \"histogram\": [";
+			for (int b = 0; b < PROFILE_CYCLE_BUCKETS; ++b)
+				file << (b ? ", " : "") << e.histogram[b];
+			file << "]}";
+			sep = ",\n";
+		}
+		file << "\n  ],\n";
+	}
+
+	// "bank" is null for addresses outside ROM
+	file << "  \"addresses\": [";
+	const char *sep = "\n";
+	for (size_t bank = 0; bank < bank_hits_.size(); ++bank) {
+		if (bank_hits_[bank] == NULL)
+			continue;
+		WORD base = bank == 0 ? 0x0000 : 0x4000;
+		for (int i = 0; i < 0x4000; ++i) {
+			const Hits &h = bank_hits_[bank][i];
+			if (h.count == 0)
+				continue;
+			file << sep << "    {\"bank\": " << bank << ", \"address\": " << base + i
+				<< ", \"count\": " << h.count << ", \"cycles\": " << h.cycles << "}";
+			sep = ",\n";
+		}
+	}
+	for (int i = 0; i < 0x8000; ++i) {
+		const Hits &h = ram_hits_[i];
+		if (h.count == 0)
+			continue;
+		file << sep << "    {\"bank\": null, \"address\": " << 0x8000 + i
+			<< ", \"count\": " << h.count << ", \"cycles\": " << h.cycles << "}";
+		sep = ",\n";
+	}
+	file << "\n  ]\n}\n";
+
+	return file.good();
+}
@@ -0,0 +1,78 @@
+// OpcodeProfile.h
+// Author: Jason Blanchard
+// Define OpcodeProfile class, which counts what the CPU executes: how often
+// each opcode (and CB opcode) runs and how many cycles it takes, and how
+// often each instruction address runs, per ROM bank.
+//
+// The CPU only feeds it when built with JMBGB_PROFILE_OPCODES defined; without
+// it the hooks in CPU::run() aren't compiled at all and
+// Emulator::profileOpcodes() just reports that profiling isn't available.
+
+#ifndef _OPCODEPROFILE_H
+#define _OPCODEPROFILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "definitions.h"
+
+// Cycle histograms have a bucket per multiple of 4 cycles, 0-28.
+const int PROFILE_CYCLE_BUCKETS = 8;
+
+class OpcodeProfile {
+public:
+	OpcodeProfile();
+	~OpcodeProfile();
+
+	// One instruction at address, in ROM bank (or -1 outside ROM). cb_op is
+	// only used when op is 0xCB.
+	void count(int bank, WORD address, BYTE op, BYTE cb_op, int cycles) {
+		Entry &e = (op == 0xCB) ? cb_opcodes_[cb_op] : opcodes_[op];
+		++e.count;
+		e.cycles += cycles;
+		++e.histogram[(cycles >> 2) < PROFILE_CYCLE_BUCKETS ? (cycles >> 2) : PROFILE_CYCLE_BUCKETS - 1];
+
+		Hits *hits = getHits(bank, address);
+		++hits->count;
+		hits->cycles += cycles;
+	}
+
+	// Write everything counted to filename: JSON if it ends in .json,
+	// otherwise CSV.
+	bool write(const std::string &filename);
+
+private:
+	struct Entry {
+		uint64_t count;
+		uint64_t cycles;
+		uint64_t histogram[PROFILE_CYCLE_BUCKETS];
+	};
+
+	struct Hits {
+		uint64_t count;
+		uint64_t cycles;
+	};
+
+	Entry opcodes_[256];
+	Entry cb_opcodes_[256];
+
+	// 16 KB of counters per ROM bank, made the first time code in the bank
+	// runs; everything from 0x8000 up shares ram_hits_
+	std::vector<Hits *> bank_hits_;
+	Hits ram_hits_[0x8000];
+
+	Hits *getHits(int bank, WORD address) {
+		if (bank < 0)
+			return &ram_hits_[address & 0x7FFF];
+		if (bank >= (int)bank_hits_.size() || bank_hits_[bank] == NULL)
+			addBank(bank);
+		return &bank_hits_[bank][address & 0x3FFF];
+	}
+	void addBank(int bank);
+
+	bool writeCSV(const std::string &filename);
+	bool writeJSON(const std::string &filename);
+};
+
+#endif
@@ -0,0 +1,199 @@
+// RewindBuffer.cpp
+// Author: Jason Blanchard
+// Implement RewindBuffer class, a ring of compressed deltas between save
+// states.
+//
+// A delta is stored as runs: a count of unchanged bytes, a count of changed
+// bytes, then the changed bytes XORed together. Counts are 7 bits per byte
+// with the top bit meaning more follows. Unchanged runs are found 8 bytes at
+// a time, since most of the state (VRAM, WRAM, cartridge RAM) doesn't change
+// from one frame to the next.
+
+#include "RewindBuffer.h"
+
+#include <cstring>
+
+// Rough smallest delta worth planning for, used to size the list of entries.
+const size_t REWIND_MIN_ENTRY = 1024;
+
+// Changes closer together than this are stored as one run.
+const size_t REWIND_MIN_GAP = 4;
+
+RewindBuffer::RewindBuffer() {
+	write_pos_ = 0;
+	first_entry_ = 0;
+	num_entries_ = 0;
+	usage_ = 0;
+}
+
+void RewindBuffer::setCapacity(size_t bytes) {
+	ring_.assign(bytes, 0);
+	entries_.assign(bytes / REWIND_MIN_ENTRY + 1, Entry());
+	clear();
+}
+
+void RewindBuffer::clear() {
+	current_.clear();
+	write_pos_ = 0;
+	first_entry_ = 0;
+	num_entries_ = 0;
+	usage_ = 0;
+}
+
+size_t RewindBuffer::getCount() {
+	return num_entries_;
+}
+
+size_t RewindBuffer::getUsage() {
+	return usage_;
+}
+
+void RewindBuffer::push(const std::vector<BYTE> &state) {
+	if (ring_.empty())
+		return;
+
+	// nothing to take a delta against (or the state changed shape), start over
+	if (current_.size() != state.size()) {
+		clear();
+		current_ = state;
+		return;
+	}
+
+	compressDelta(&current_[0], &state[0], state.size());
+	current_ = state;
+
+	size_t size = scratch_.size();
+	if (size > ring_.size()) {
+		// can't be kept at all, so there's no going back past here
+		std::vector<BYTE> newest;
+		newest.swap(current_);
+		clear();
+		current_.swap(newest);
+		return;
+	}
+
+	// doesn't fit before the end of the ring, so the tail is skipped and
+	// anything still in it goes
+	if (write_pos_ + size > ring_.size()) {
+		while (num_entries_ > 0 && entries_[first_entry_].offset >= write_pos_)
+			dropOldest();
+		write_pos_ = 0;
+	}
+
+	// make room over the oldest deltas
+	while (num_entries_ > 0) {
+		const Entry &oldest = entries_[first_entry_];
+		bool overlaps = oldest.offset < write_pos_ + size && oldest.offset + oldest.size > write_pos_;
+		if (!overlaps && num_entries_ < entries_.size())
+			break;
+		dropOldest();
+	}
+
+	Entry &e = entries_[(first_entry_ + num_entries_) % entries_.size()];
+	e.offset = write_pos_;
+	e.size = size;
+	memcpy(&ring_[write_pos_], &scratch_[0], size);
+	write_pos_ += size;
+	usage_ += size;
+	++num_entries_;
+}
+
+bool RewindBuffer::pop(std::vector<BYTE> &state) {
+	if (num_entries_ == 0)
+		return false;
+
+	--num_entries_;
+	const Entry &e = entries_[(first_entry_ + num_entries_) % entries_.size()];
+	applyDelta(&ring_[e.offset], e.size, &current_[0], current_.size());
+	write_pos_ = e.offset;
+	usage_ -= e.size;
+
+	state = current_;
+	return true;
+}
+
+void RewindBuffer::dropOldest() {
+	usage_ -= entries_[first_entry_].size;
+	first_entry_ = (first_entry_ + 1) % entries_.size();
+	--num_entries_;
+}
+
+static void putLength(std::vector<BYTE> &out, size_t n) {
+	while (n >= 0x80) {
+		out.push_back((BYTE)(n | 0x80));
+		n >>= 7;
+	}
+	out.push_back((BYTE)n);
+}
+
+static size_t getLength(const BYTE *&in, const BYTE *end) {
+	size_t n = 0;
+	int shift = 0;
+	while (in < end) {
+		BYTE b = *in++;
+		n |= (size_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			break;
+		shift += 7;
+	}
+	return n;
+}
+
+// Builds the delta that turns newer back into older in scratch_.
+void RewindBuffer::compressDelta(const BYTE *older, const BYTE *newer, size_t size) {
+	scratch_.clear();
+
+	size_t i = 0;
+	while (i < size) {
+		// unchanged run
+		size_t start = i;
+		while (i + 8 <= size) {
+			uint64_t a, b;
+			memcpy(&a, &older[i], 8);
+			memcpy(&b, &newer[i], 8);
+			if (a != b)
+				break;
+			i += 8;
+		}
+		while (i < size && older[i] == newer[i])
+			++i;
+		size_t same = i - start;
+
+		// changed run, carrying on through short gaps of unchanged bytes
+		start = i;
+		while (i < size) {
+			if (older[i] != newer[i]) {
+				++i;
+				continue;
+			}
+
+			size_t j = i;
+			while (j < size && j - i < REWIND_MIN_GAP && older[j] == newer[j])
+				++j;
+			if (j - i >= REWIND_MIN_GAP || j == size)
+				break;
+			i = j;
+		}
+
+		putLength(scratch_, same);
+		putLength(scratch_, i - start);
+		for (size_t k = start; k < i; ++k)
+			scratch_.push_back(older[k] ^ newer[k]);
+	}
+}
+
+void RewindBuffer::applyDelta(const BYTE *delta, size_t delta_size, BYTE *state, size_t size) {
+	const BYTE *end = delta + delta_size;
+	size_t pos = 0;
+	while (delta < end && pos < size) {
+		pos += getLength(delta, end);
+		size_t changed = getLength(delta, end);
+		if (pos + changed > size || changed > (size_t)(end - delta))
+			break;
+
+		for (size_t k = 0; k < changed; ++k)
+			state[pos + k] ^= delta[k];
+		delta += changed;
+		pos += changed;
+	}
+}
@@ -0,0 +1,58 @@
+// RewindBuffer.h
+// Author: Jason Blanchard
+// Define RewindBuffer class, which keeps a history of save states to step back
+// through. Only the newest state is kept whole. Every older one is stored as
+// the XOR of it and the state after it, which is almost all zeros frame to
+// frame, and those zeros are squeezed out. The deltas live in one fixed-size
+// ring, and the oldest are dropped when it fills up.
+
+#ifndef _REWINDBUFFER_H
+#define _REWINDBUFFER_H
+
+#include <vector>
+#include <cstddef>
+
+#include "definitions.h"
+
+class RewindBuffer {
+public:
+	RewindBuffer();
+
+	// Sets how much memory the deltas can use, and drops the history.
+	void setCapacity(size_t bytes);
+	void clear();
+
+	// Add a state as the newest.
+	void push(const std::vector<BYTE> &state);
+
+	// Step back to the state before the newest, which becomes the newest.
+	// Returns false if there's nothing to go back to.
+	bool pop(std::vector<BYTE> &state);
+
+	// number of states that can be stepped back to, and bytes used by them
+	size_t getCount();
+	size_t getUsage();
+
+private:
+	struct Entry {
+		size_t offset;
+		size_t size;
+	};
+
+	std::vector<BYTE> current_; // newest state, whole
+	std::vector<BYTE> ring_;    // compressed deltas
+	std::vector<BYTE> scratch_; // delta being compressed
+	size_t write_pos_;
+
+	// deltas in the ring, oldest first, as a circular list
+	std::vector<Entry> entries_;
+	size_t first_entry_;
+	size_t num_entries_;
+	size_t usage_;
+
+	void dropOldest();
+	void compressDelta(const BYTE *older, const BYTE *newer, size_t size);
+	void applyDelta(const BYTE *delta, size_t delta_size, BYTE *state, size_t size);
+};
+
+#endif
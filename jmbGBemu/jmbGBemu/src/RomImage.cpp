@@ -0,0 +1,131 @@
+// RomImage.cpp
+// Author: Jason Blanchard
+// Implement RomImage class, which holds the read-only contents of a cartridge ROM.
+// Images are shared, so any number of emulators running the same game only
+// keep one copy of it in memory.
+
+#include "RomImage.h"
+#include "Log.h"
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <cstring>
+
+// Images currently loaded, by filename. Only weak references are kept so an
+// image goes away with the last emulator using it.
+static std::map<std::string, std::weak_ptr<const RomImage> > loaded_images;
+static std::mutex loaded_images_lock;
+
+RomImage::RomImage() {
+	data_ = NULL;
+	num_banks_ = 0;
+}
+
+RomImage::~RomImage() { }
+
+std::shared_ptr<const RomImage> RomImage::load(const std::string &filename) {
+	std::lock_guard<std::mutex> lock(loaded_images_lock);
+
+	std::shared_ptr<const RomImage> image = loaded_images[filename].lock();
+	if (image)
+		return image;
+
+	std::shared_ptr<RomImage> new_image(new RomImage());
+	new_image->filename_ = filename;
+
+	if (!new_image->mapped_.openReadOnly(filename) || !new_image->useMapping()) {
+		// copy fallback, for anything we can't point straight into
+		new_image->mapped_.close();
+
+		std::ifstream file(filename.c_str(), std::ios::binary);
+		if (!file.is_open())
+			return std::shared_ptr<const RomImage>();
+
+		std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		file.close();
+
+		const BYTE *data = (const BYTE *)(contents.empty() ? NULL : &contents[0]);
+		if (contents.size() >= 2 && ((data[0] == 0x1F && data[1] == 0x8B) || (data[0] == 'P' && data[1] == 'K'))) {
+			// there's no decompressor built in; callers with one can hand the
+			// decompressed data to fromMemory()
+			EMULOG_ERROR("ROM file is compressed, decompress it first.");
+			return std::shared_ptr<const RomImage>();
+		}
+
+		new_image->setData(data, contents.size());
+	}
+
+	loaded_images[filename] = new_image;
+	return new_image;
+}
+
+std::shared_ptr<const RomImage> RomImage::fromMemory(const BYTE *data, size_t size) {
+	std::shared_ptr<RomImage> image(new RomImage());
+	image->setData(data, size);
+	return image;
+}
+
+// Whether the mapped file can be used as the image directly: it has to be
+// whole banks, at least as many as the header declares (a short file would
+// need padding), and not compressed.
+bool RomImage::useMapping() {
+	const BYTE *data = mapped_.getData();
+	size_t size = mapped_.getSize();
+
+	if (size % 0x4000 != 0 || size < 0x8000)
+		return false;
+	if (data[0] == 0x1F && data[1] == 0x8B)
+		return false;
+	if ((int)(size / 0x4000) < getDeclaredBanks(data, size))
+		return false;
+
+	num_banks_ = (int)(size / 0x4000);
+	data_ = data;
+
+	// bank switching makes access random, so don't bother reading ahead,
+	// but do fault in bank 0 (header, vectors, startup code) straight away
+	mapped_.adviseRandom();
+	mapped_.adviseWillNeed(0, 0x4000);
+
+	return true;
+}
+
+// Number of 16 KB banks the cartridge header says the ROM has, or 0 if the
+// data is too short to have a header or the size byte is unknown.
+int RomImage::getDeclaredBanks(const BYTE *data, size_t size) {
+	if (size <= 0x148)
+		return 0;
+
+	BYTE rom_size = data[0x148];
+	if (rom_size <= 0x08)
+		return 2 << rom_size;
+	else if (rom_size == 0x52)
+		return 72;
+	else if (rom_size == 0x53)
+		return 80;
+	else if (rom_size == 0x54)
+		return 96;
+
+	return 0;
+}
+
+// Copy the ROM data in, sized to whole banks. The cartridge header's declared
+// size is honoured even if the file is short (the missing part reads as 0xFF),
+// and there are always at least the two banks of a plain 32 KB cartridge.
+void RomImage::setData(const BYTE *data, size_t size) {
+	int banks = (int)((size + 0x3FFF) / 0x4000);
+
+	int declared = getDeclaredBanks(data, size);
+	if (declared > banks)
+		banks = declared;
+
+	if (banks < 2)
+		banks = 2;
+
+	num_banks_ = banks;
+	storage_.assign((size_t)banks * 0x4000, 0xFF);
+	if (size > 0)
+		memcpy(&storage_[0], data, size);
+	data_ = &storage_[0];
+}
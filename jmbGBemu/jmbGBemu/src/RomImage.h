@@ -0,0 +1,58 @@
+// RomImage.h
+// Author: Jason Blanchard
+// Define RomImage class, which holds the read-only contents of a cartridge ROM.
+// Images are shared, so any number of emulators running the same game only
+// keep one copy of it in memory.
+
+#ifndef _ROMIMAGE_H
+#define _ROMIMAGE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "definitions.h"
+#include "MappedFile.h"
+
+class RomImage {
+public:
+	~RomImage();
+
+	// Load a ROM file, or return the image already loaded for that file if
+	// another instance still holds it. Returns null if the file can't be read.
+	// Where possible the file is mapped read-only and banks point straight
+	// into the mapping, so nothing is copied and the pages are shared with
+	// every other process running the same file through the page cache.
+	static std::shared_ptr<const RomImage> load(const std::string &filename);
+
+	// Make an image from ROM data already in memory (copied).
+	static std::shared_ptr<const RomImage> fromMemory(const BYTE *data, size_t size);
+
+	// Base of a 16 KB bank. Bank numbers wrap around the number of banks,
+	// like the unconnected upper address lines on a real cartridge.
+	const BYTE *getBank(int bank) const {
+		return data_ + (size_t)(bank % num_banks_) * 0x4000;
+	}
+
+	int getNumBanks() const { return num_banks_; }
+	size_t getSize() const { return (size_t)num_banks_ * 0x4000; }
+	const std::string &getFilename() const { return filename_; }
+	bool isMapped() const { return mapped_.isOpen(); }
+
+private:
+	RomImage();
+	RomImage(const RomImage &);
+	RomImage &operator=(const RomImage &);
+
+	std::string filename_;
+	MappedFile mapped_;
+	std::vector<BYTE> storage_; // used when the ROM can't be mapped as is
+	const BYTE *data_;
+	int num_banks_;
+
+	static int getDeclaredBanks(const BYTE *data, size_t size);
+	bool useMapping();
+	void setData(const BYTE *data, size_t size);
+};
+
+#endif
@@ -0,0 +1,98 @@
+// SaveState.cpp
+// Author: Jason Blanchard
+// Implement StateWriter and StateReader, the flat little-endian buffer save
+// states are written to and read from.
+
+#include "SaveState.h"
+
+#include <cstring>
+
+StateWriter::StateWriter(std::vector<BYTE> &out) : out_(out) {
+	out_.clear();
+}
+
+void StateWriter::put8(BYTE val) {
+	out_.push_back(val);
+}
+
+void StateWriter::put16(WORD val) {
+	out_.push_back(val & 0xFF);
+	out_.push_back(val >> 8);
+}
+
+void StateWriter::put32(uint32_t val) {
+	for (int i = 0; i < 4; ++i) {
+		out_.push_back(val & 0xFF);
+		val >>= 8;
+	}
+}
+
+void StateWriter::put64(uint64_t val) {
+	put32((uint32_t)val);
+	put32((uint32_t)(val >> 32));
+}
+
+void StateWriter::putBool(bool val) {
+	out_.push_back(val ? 1 : 0);
+}
+
+void StateWriter::putBytes(const BYTE *data, size_t size) {
+	out_.insert(out_.end(), data, data + size);
+}
+
+StateReader::StateReader(const BYTE *data, size_t size) {
+	data_ = data;
+	size_ = size;
+	pos_ = 0;
+	failed_ = false;
+}
+
+BYTE StateReader::get8() {
+	if (pos_ + 1 > size_) {
+		failed_ = true;
+		return 0;
+	}
+
+	return data_[pos_++];
+}
+
+WORD StateReader::get16() {
+	WORD lo = get8();
+	return lo | (get8() << 8);
+}
+
+uint32_t StateReader::get32() {
+	uint32_t val = 0;
+	for (int i = 0; i < 4; ++i)
+		val |= (uint32_t)get8() << (i * 8);
+	return val;
+}
+
+uint64_t StateReader::get64() {
+	uint64_t lo = get32();
+	return lo | ((uint64_t)get32() << 32);
+}
+
+bool StateReader::getBool() {
+	return get8() != 0;
+}
+
+void StateReader::getBytes(BYTE *dest, size_t size) {
+	if (size > size_ - pos_) {
+		failed_ = true;
+		memset(dest, 0, size);
+		pos_ = size_;
+		return;
+	}
+
+	memcpy(dest, &data_[pos_], size);
+	pos_ += size;
+}
+
+bool StateReader::failed() {
+	return failed_;
+}
+
+size_t StateReader::remaining() {
+	return size_ - pos_;
+}
@@ -0,0 +1,59 @@
+// SaveState.h
+// Author: Jason Blanchard
+// Define StateWriter and StateReader, used to snapshot the whole machine into
+// one flat little-endian buffer and bring it back. Each part of the emulator
+// writes its own fields in a fixed order, so the format is just the sequence
+// of writes; STATE_VERSION has to go up whenever that sequence changes.
+
+#ifndef _SAVESTATE_H
+#define _SAVESTATE_H
+
+#include <vector>
+#include <cstddef>
+
+#include "definitions.h"
+
+const uint32_t STATE_MAGIC = 0x53424D4A; // "JMBS"
+const uint32_t STATE_VERSION = 2;
+
+class StateWriter {
+public:
+	// Writes into out, replacing what's there. The vector keeps its capacity,
+	// so saving into the same one again doesn't allocate.
+	StateWriter(std::vector<BYTE> &out);
+
+	void put8(BYTE val);
+	void put16(WORD val);
+	void put32(uint32_t val);
+	void put64(uint64_t val);
+	void putBool(bool val);
+	void putBytes(const BYTE *data, size_t size);
+
+private:
+	std::vector<BYTE> &out_;
+};
+
+class StateReader {
+public:
+	StateReader(const BYTE *data, size_t size);
+
+	// Reading past the end gives zeros and marks the reader as failed, so
+	// callers only need to check once at the end.
+	BYTE get8();
+	WORD get16();
+	uint32_t get32();
+	uint64_t get64();
+	bool getBool();
+	void getBytes(BYTE *dest, size_t size);
+
+	bool failed();
+	size_t remaining();
+
+private:
+	const BYTE *data_;
+	size_t size_;
+	size_t pos_;
+	bool failed_;
+};
+
+#endif
@@ -0,0 +1,231 @@
+// TraceBuffer.cpp
+// Author: Jason Blanchard
+// Implement TraceBuffer class, a ring of executed instructions that can be
+// dumped on demand or when the process crashes.
+
+#include "TraceBuffer.h"
+#include "Log.h"
+
+#include <atomic>
+#include <thread>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+// Plain file descriptors rather than streams, as these are also used from
+// the crash handler.
+static int createFile(const char *filename) {
+#ifdef _WIN32
+	return _open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	return open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+}
+
+static bool writeAll(int fd, const void *data, uint64_t size) {
+	const char *p = (const char *)data;
+	while (size > 0) {
+		unsigned int chunk = size < (1u << 30) ? (unsigned int)size : (1u << 30);
+#ifdef _WIN32
+		int written = _write(fd, p, chunk);
+#else
+		int written = (int)write(fd, p, chunk);
+#endif
+		if (written <= 0)
+			return false;
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+static void closeFile(int fd) {
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+// Traces that are written out if we crash.
+const int TRACE_MAX_CRASH_DUMPS = 16;
+static std::atomic<TraceBuffer *> crash_traces[TRACE_MAX_CRASH_DUMPS];
+static std::atomic<bool> crash_handler_installed(false);
+static std::atomic<bool> crash_dumped(false);
+// handlers part way through writing traces, which have to finish before a
+// trace they might be writing can change or go away
+static std::atomic<int> crash_handlers_running(0);
+
+static const int CRASH_SIGNALS[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL };
+const int NUM_CRASH_SIGNALS = sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]);
+
+// What was handling each signal before us, which we hand the signal on to.
+#ifdef _WIN32
+typedef void (*SignalHandler)(int);
+static SignalHandler previous_handlers[NUM_CRASH_SIGNALS];
+
+static void handleCrash(int sig) {
+	TraceBuffer::writeCrashDumps();
+
+	for (int i = 0; i < NUM_CRASH_SIGNALS; ++i) {
+		if (CRASH_SIGNALS[i] != sig)
+			continue;
+		SignalHandler previous = previous_handlers[i];
+		if (previous == SIG_IGN)
+			return;
+		// Windows has already put back SIG_DFL for this one
+		std::signal(sig, previous);
+		if (previous == SIG_DFL)
+			std::raise(sig);
+		else
+			previous(sig);
+		return;
+	}
+}
+
+static void installCrashHandler() {
+	for (int i = 0; i < NUM_CRASH_SIGNALS; ++i)
+		previous_handlers[i] = std::signal(CRASH_SIGNALS[i], handleCrash);
+}
+#else
+static struct sigaction previous_actions[NUM_CRASH_SIGNALS];
+
+static void handleCrash(int sig, siginfo_t *info, void *context) {
+	TraceBuffer::writeCrashDumps();
+
+	for (int i = 0; i < NUM_CRASH_SIGNALS; ++i) {
+		if (CRASH_SIGNALS[i] != sig)
+			continue;
+		const struct sigaction &previous = previous_actions[i];
+		if (previous.sa_flags & SA_SIGINFO) {
+			previous.sa_sigaction(sig, info, context);
+		} else if (previous.sa_handler == SIG_DFL) {
+			// carry on crashing the way we would have
+			sigaction(sig, &previous, NULL);
+			raise(sig);
+		} else if (previous.sa_handler != SIG_IGN) {
+			previous.sa_handler(sig);
+		}
+		return;
+	}
+}
+
+static void installCrashHandler() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = handleCrash;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	for (int i = 0; i < NUM_CRASH_SIGNALS; ++i)
+		sigaction(CRASH_SIGNALS[i], &action, &previous_actions[i]);
+}
+#endif
+
+TraceBuffer::TraceBuffer(uint32_t num_records, const uint64_t *clock) {
+	uint64_t size = 1;
+	while (size < num_records)
+		size <<= 1;
+
+	records_ = new TraceRecord[(size_t)size];
+	memset(records_, 0, (size_t)size * sizeof(TraceRecord));
+	mask_ = size - 1;
+	next_ = 0;
+	clock_ = clock;
+	crash_filename_[0] = '\0';
+}
+
+TraceBuffer::~TraceBuffer() {
+	// waits for a crash handler that might be writing us out
+	dumpOnCrash("");
+	delete[] records_;
+}
+
+bool TraceBuffer::write(const std::string &filename) {
+	if (!writeRaw(filename.c_str())) {
+		EMULOG_ERROR("Couldn't write trace %s", filename);
+		return false;
+	}
+	return true;
+}
+
+void TraceBuffer::dumpOnCrash(const std::string &crash_filename) {
+	for (int i = 0; i < TRACE_MAX_CRASH_DUMPS; ++i) {
+		TraceBuffer *expected = this;
+		crash_traces[i].compare_exchange_strong(expected, NULL);
+	}
+	while (crash_handlers_running.load() != 0)
+		std::this_thread::yield();
+	if (crash_filename.empty())
+		return;
+
+	if (crash_filename.size() >= sizeof(crash_filename_)) {
+		EMULOG_ERROR("Trace filename is too long: %s", crash_filename);
+		return;
+	}
+	memcpy(crash_filename_, crash_filename.c_str(), crash_filename.size() + 1);
+
+	bool added = false;
+	for (int i = 0; i < TRACE_MAX_CRASH_DUMPS && !added; ++i) {
+		TraceBuffer *expected = NULL;
+		added = crash_traces[i].compare_exchange_strong(expected, this);
+	}
+	if (!added) {
+		EMULOG_WARNING("Too many traces to dump on a crash, %s won't be written.", crash_filename);
+		return;
+	}
+
+	if (!crash_handler_installed.exchange(true))
+		installCrashHandler();
+}
+
+// Only the first crash is written out. A host that recovers from a signal
+// and carries on (a JVM does, for one) would otherwise have the dumps
+// written again every time.
+void TraceBuffer::writeCrashDumps() {
+	// counted before looking at the traces, so dumpOnCrash() either sees us
+	// running or we see what it left registered
+	crash_handlers_running.fetch_add(1);
+	if (!crash_dumped.exchange(true)) {
+		for (int i = 0; i < TRACE_MAX_CRASH_DUMPS; ++i) {
+			TraceBuffer *trace = crash_traces[i].load();
+			if (trace != NULL)
+				trace->writeRaw(trace->crash_filename_);
+		}
+	}
+	crash_handlers_running.fetch_sub(1);
+}
+
+// Oldest record first: once the ring has wrapped that's the one next_ is
+// about to overwrite, so the dump is at most two writes of the ring.
+bool TraceBuffer::writeRaw(const char *filename) {
+	int fd = createFile(filename);
+	if (fd < 0)
+		return false;
+
+	uint64_t size = mask_ + 1;
+	uint64_t count = next_ < size ? next_ : size;
+	uint64_t first = (next_ - count) & mask_;
+
+	TraceHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(TraceRecord);
+	header.count = count;
+
+	uint64_t before_wrap = size - first < count ? size - first : count;
+	bool ok = writeAll(fd, &header, sizeof(header));
+	ok = ok && writeAll(fd, &records_[first], before_wrap * sizeof(TraceRecord));
+	ok = ok && writeAll(fd, &records_[0], (count - before_wrap) * sizeof(TraceRecord));
+
+	closeFile(fd);
+	return ok;
+}
@@ -0,0 +1,99 @@
+// TraceBuffer.h
+// Author: Jason Blanchard
+// Define TraceBuffer class, which keeps the last few thousand instructions
+// the CPU ran, with the registers as they were before each one, so that a
+// crash or a divergence between two runs can be looked at afterwards.
+// Records are fixed size and written straight into a ring, so tracing can
+// be left on; with it off the CPU only checks for a NULL pointer.
+//
+// A dump (see write()) is a TraceHeader followed by the records, oldest
+// first, in the host's byte order. jmbgb-trace prints and compares them.
+
+#ifndef _TRACEBUFFER_H
+#define _TRACEBUFFER_H
+
+#include <string>
+#include <cstdint>
+
+#include "definitions.h"
+
+const uint32_t TRACE_MAGIC = 0x54424D4A; // "JMBT"
+const uint32_t TRACE_VERSION = 1;
+
+// Records kept unless asked otherwise, a few frames' worth. Small enough
+// (1.5 MB) to stay in cache; a much bigger ring costs noticeably more to
+// write to.
+const uint32_t TRACE_DEFAULT_RECORDS = 1 << 16;
+
+// TraceRecord::flags
+const BYTE TRACE_FLAG_IME = 0x01; // interrupts enabled
+
+struct TraceRecord {
+	uint64_t cycle;  // emulated clocks since power on, at the fetch
+	uint16_t pc;
+	uint16_t bank;   // ROM bank mapped at pc, 0xFFFF outside ROM
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t af;
+	uint16_t bc;
+	uint16_t de;
+	uint16_t hl;
+	uint16_t sp;
+};
+
+struct TraceHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t reserved;
+	uint64_t count; // records following
+};
+
+class TraceBuffer {
+public:
+	// Keep the last num_records (rounded up to a power of two) instructions.
+	// clock is read for each record's cycle.
+	TraceBuffer(uint32_t num_records, const uint64_t *clock);
+	~TraceBuffer();
+
+	void record(WORD pc, int bank, BYTE opcode, BYTE flags, WORD af, WORD bc, WORD de, WORD hl, WORD sp) {
+		TraceRecord &r = records_[next_++ & mask_];
+		r.cycle = *clock_;
+		r.pc = pc;
+		r.bank = (uint16_t)bank;
+		r.opcode = opcode;
+		r.flags = flags;
+		r.af = af;
+		r.bc = bc;
+		r.de = de;
+		r.hl = hl;
+		r.sp = sp;
+	}
+
+	// Write what's in the ring to filename.
+	bool write(const std::string &filename);
+
+	// Also write to crash_filename if the process crashes (SIGSEGV, SIGABRT,
+	// SIGFPE or SIGILL). Pass an empty name to stop. The handlers are put in
+	// the first time this is called and pass the signal on to whatever was
+	// handling it before, so a host's own crash handling still runs.
+	void dumpOnCrash(const std::string &crash_filename);
+
+	// Write every trace registered with dumpOnCrash(), once. Only for the
+	// crash handler.
+	static void writeCrashDumps();
+
+private:
+	TraceRecord *records_;
+	uint64_t mask_;
+	uint64_t next_; // records made, the next goes at next_ & mask_
+	const uint64_t *clock_;
+
+	// kept ready so the crash handler doesn't need to allocate
+	char crash_filename_[1024];
+
+	// write() without anything a signal handler can't use
+	bool writeRaw(const char *filename);
+};
+
+#endif
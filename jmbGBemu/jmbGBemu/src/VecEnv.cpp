@@ -0,0 +1,170 @@
+// VecEnv.cpp
+// Author: Jason Blanchard
+// Implement VecEnv class, a batch of emulators stepped together.
+
+#include "VecEnv.h"
+#include "Emulator.h"
+
+#include <cstring>
+
+const int FRAME_SIZE = 144 * 160;
+
+VecEnv::VecEnv(std::shared_ptr<const RomImage> rom, int num_envs, int num_threads) {
+	if (num_envs < 1)
+		num_envs = 1;
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency();
+	if (num_threads <= 0)
+		num_threads = 1;
+
+	for (int i = 0; i < num_envs; ++i) {
+		Emulator *env = new Emulator();
+		env->initialize(rom);
+		env->setSpeed(SPEED_UNCAPPED);
+		envs_.push_back(env);
+	}
+	captureStart(0);
+
+	task_ = TASK_STEP;
+	mask_ = NULL;
+	actions_ = NULL;
+	frames_ = 0;
+	observations_ = NULL;
+	ram_ = NULL;
+
+	num_parts_ = num_threads < num_envs ? num_threads : num_envs;
+	generation_ = 0;
+	busy_ = 0;
+	quitting_ = false;
+	for (int i = 1; i < num_parts_; ++i)
+		threads_.push_back(std::thread(&VecEnv::workerMain, this, i));
+}
+
+VecEnv::~VecEnv() {
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		quitting_ = true;
+	}
+	start_.notify_all();
+	for (size_t i = 0; i < threads_.size(); ++i)
+		threads_[i].join();
+
+	for (size_t i = 0; i < envs_.size(); ++i)
+		delete envs_[i];
+}
+
+int VecEnv::getNumEnvs() {
+	return (int)envs_.size();
+}
+
+int VecEnv::getNumThreads() {
+	return num_parts_;
+}
+
+Emulator *VecEnv::getEnv(int env) {
+	return envs_[env];
+}
+
+void VecEnv::setRamAddresses(const WORD *addresses, int count) {
+	ram_addresses_.assign(addresses, addresses + count);
+}
+
+int VecEnv::getNumRamAddresses() {
+	return (int)ram_addresses_.size();
+}
+
+void VecEnv::captureStart(int env) {
+	envs_[env]->saveState(start_state_);
+	memcpy(start_frame_, envs_[env]->getFrameBuffer(), FRAME_SIZE);
+}
+
+void VecEnv::reset(const BYTE *mask, BYTE *observations, BYTE *ram) {
+	mask_ = mask;
+	observations_ = observations;
+	ram_ = ram;
+	runBatch(TASK_RESET);
+}
+
+void VecEnv::step(const BYTE *actions, int frames, BYTE *observations, BYTE *ram) {
+	actions_ = actions;
+	frames_ = frames;
+	observations_ = observations;
+	ram_ = ram;
+	runBatch(TASK_STEP);
+}
+
+// Wake the workers, do part 0 here, then wait for the rest.
+void VecEnv::runBatch(Task task) {
+	task_ = task;
+
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		++generation_;
+		busy_ = num_parts_ - 1;
+	}
+	start_.notify_all();
+
+	runPart(0);
+
+	std::unique_lock<std::mutex> lock(lock_);
+	while (busy_ > 0)
+		done_.wait(lock);
+}
+
+// Envs are split into num_parts_ runs of (nearly) equal length.
+void VecEnv::runPart(int part) {
+	int num_envs = (int)envs_.size();
+	int first = part * num_envs / num_parts_;
+	int last = (part + 1) * num_envs / num_parts_;
+	int num_ram = (int)ram_addresses_.size();
+
+	for (int i = first; i < last; ++i) {
+		Emulator *env = envs_[i];
+		// the env draws straight into the caller's buffer for this call only
+		if (observations_ != NULL)
+			env->setFrameBuffer(observations_ + (size_t)i * FRAME_SIZE);
+
+		if (task_ == TASK_RESET) {
+			if (mask_ == NULL || mask_[i]) {
+				env->loadState(&start_state_[0], start_state_.size());
+				env->setFrame(start_frame_);
+			}
+		} else {
+			env->setButtons(actions_[i]);
+			for (int f = 0; f < frames_; ++f)
+				env->runFrame();
+		}
+
+		if (ram_ != NULL) {
+			BYTE *out = ram_ + (size_t)i * num_ram;
+			for (int k = 0; k < num_ram; ++k)
+				out[k] = env->peekMemory(ram_addresses_[k]);
+		}
+
+		// copy the frame back and let go of the buffer, which the caller is
+		// free to reuse or free once we return
+		if (observations_ != NULL)
+			env->setFrameBuffer(NULL);
+	}
+}
+
+void VecEnv::workerMain(int part) {
+	uint64_t seen = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(lock_);
+			while (generation_ == seen && !quitting_)
+				start_.wait(lock);
+			if (quitting_)
+				return;
+			seen = generation_;
+		}
+
+		runPart(part);
+
+		std::lock_guard<std::mutex> lock(lock_);
+		if (--busy_ == 0)
+			done_.notify_one();
+	}
+}
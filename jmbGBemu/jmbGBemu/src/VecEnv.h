@@ -0,0 +1,84 @@
+// VecEnv.h
+// Author: Jason Blanchard
+// Define VecEnv class, a batch of emulators running the same game that are
+// stepped together, one action each, for training agents. Each step hands
+// back every env's frame as one [envs][144][160] block of shade numbers,
+// plus a few bytes of RAM per env (score, lives, position...).
+//
+// The envs are split evenly over a set of threads that live as long as the
+// VecEnv, so a step costs a wake up and a wait rather than starting threads.
+// Frames are drawn straight into the caller's observation buffer during a
+// step, then copied back once so nothing holds on to it afterwards.
+
+#ifndef _VECENV_H
+#define _VECENV_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "definitions.h"
+#include "RomImage.h"
+
+class VecEnv {
+public:
+	// num_threads <= 0 uses one per hardware thread. Never more threads
+	// than envs are used.
+	VecEnv(std::shared_ptr<const RomImage> rom, int num_envs, int num_threads);
+	~VecEnv();
+
+	int getNumEnvs();
+	int getNumThreads();
+	Emulator *getEnv(int env);
+
+	// Addresses read from every env after each step and reset, in order.
+	void setRamAddresses(const WORD *addresses, int count);
+	int getNumRamAddresses();
+
+	// Make env's current state (and picture) where every reset goes back
+	// to. Until then it's power on.
+	void captureStart(int env);
+
+	// Put the envs where mask is non-zero (all of them if mask is NULL)
+	// back at the start.
+	void reset(const BYTE *mask, BYTE *observations, BYTE *ram);
+
+	// Run every env for frames frames holding actions[env] (buttons as in
+	// buttonBit()). observations is envs x 144 x 160 bytes and ram is envs x
+	// getNumRamAddresses() bytes; either can be NULL. Neither is used once
+	// this returns, so they can be a new buffer every time.
+	void step(const BYTE *actions, int frames, BYTE *observations, BYTE *ram);
+
+private:
+	std::vector<Emulator*> envs_;
+	std::vector<WORD> ram_addresses_;
+	std::vector<BYTE> start_state_;
+	BYTE start_frame_[144 * 160];
+
+	// the batch being worked on, set before the workers are woken
+	enum Task { TASK_RESET, TASK_STEP };
+	Task task_;
+	const BYTE *mask_;
+	const BYTE *actions_;
+	int frames_;
+	BYTE *observations_;
+	BYTE *ram_;
+
+	// workers 1 and up; the calling thread does part 0
+	int num_parts_;
+	std::vector<std::thread> threads_;
+	std::mutex lock_;
+	std::condition_variable start_;
+	std::condition_variable done_;
+	uint64_t generation_;
+	int busy_;
+	bool quitting_;
+
+	void runBatch(Task task);
+	void runPart(int part);
+	void workerMain(int part);
+};
+
+#endif
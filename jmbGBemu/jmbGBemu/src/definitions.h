@@ -6,24 +6,38 @@
 #define _DEFINITIONS_H
 
 #include <cstdint>
-#include <SDL.h>
+#include <cstddef>
 
 // forward declarations
 class Emulator;
 class CPU;
 class MMU;
 class HeaderInfo;
+class MBC;
 
 typedef void (CPU::*fn)(); // typedef for function pointers
 typedef uint8_t BYTE;
 typedef uint16_t WORD;
 
 const int FRAME_RATE = 60;
+const int CLOCK_SPEED = 4194304; // Hz
 const int CLOCKS_PER_FRAME = 70224;
+const double FRAME_RATE_EXACT = (double)CLOCK_SPEED / CLOCKS_PER_FRAME; // ~59.7275 Hz
+const int CLOCKS_PER_LINE = 456;
 const int CLOCKS_MODE_0 = 204;
 const int CLOCKS_MODE_1 = 4560;
 const int CLOCKS_MODE_2 = 80;
 const int CLOCKS_MODE_3 = 172;
+const int CLOCKS_DMA = 640; // OAM DMA, 160 machine cycles
+
+// Speed multiplier meaning "don't pace at all, run as fast as the host allows".
+const double SPEED_UNCAPPED = 0.0;
+
+// How many frames go by between asynchronous write backs of the .sav file (~5 seconds).
+const int SAVE_FLUSH_FRAMES = 300;
+
+// Memory for rewind history, about a minute of snapshots taken every frame.
+const size_t REWIND_CAPACITY = 20 * 1024 * 1024;
 
 enum Mode {
 	MODE_0 = 0,
@@ -32,6 +46,14 @@ enum Mode {
 	MODE_3
 };
 
+// RGB colours for the four shades, lightest first.
+struct Palette {
+	BYTE rgb[4][3];
+};
+
+const Palette PALETTE_GREEN = {{ {224, 248, 208}, {136, 192, 112}, {52, 104, 86}, {0, 0, 0} }};
+const Palette PALETTE_GRAYSCALE = {{ {255, 255, 255}, {170, 170, 170}, {85, 85, 85}, {0, 0, 0} }};
+
 enum Button {
 	BUTTON_UP = 0,
 	BUTTON_DOWN,
@@ -0,0 +1,257 @@
+// jmbgb.cpp
+// Author: Jason Blanchard
+// Implement the C interface to the emulation core on top of Emulator.
+//
+// C callers can't catch exceptions, so every entry point that can throw
+// (mostly std::bad_alloc) catches everything and returns failure instead.
+
+#include "jmbgb.h"
+#include "Emulator.h"
+#include "VecEnv.h"
+#include "Log.h"
+
+#include <new>
+#include <memory>
+#include <exception>
+#include <cstring>
+
+struct jmbgb {
+	Emulator *emu;
+	std::vector<BYTE> state; // scratch space for jmbgb_save_state()
+};
+
+struct jmbgb_vecenv {
+	VecEnv *envs;
+};
+
+// Call from a catch (...) block to log what was caught.
+static void logException(const char *function) {
+	try {
+		throw;
+	} catch (const std::exception &e) {
+		EMULOG_ERROR("%s failed: %s", function, e.what());
+	} catch (...) {
+		EMULOG_ERROR("%s failed.", function);
+	}
+}
+
+void jmbgb_set_log_level(int level) {
+	emulog::setLevel(level);
+}
+
+int jmbgb_set_log_file(const char *filename) {
+	try {
+		if (filename == NULL) {
+			emulog::closeFile();
+			return 0;
+		}
+		return emulog::setFile(filename) ? 0 : -1;
+	} catch (...) {
+		logException("jmbgb_set_log_file");
+		return -1;
+	}
+}
+
+jmbgb *jmbgb_create(void) {
+	jmbgb *gb = new (std::nothrow) jmbgb;
+	if (gb == NULL)
+		return NULL;
+
+	gb->emu = NULL;
+	return gb;
+}
+
+void jmbgb_destroy(jmbgb *gb) {
+	if (gb == NULL)
+		return;
+
+	delete gb->emu;
+	delete gb;
+}
+
+int jmbgb_load_rom(jmbgb *gb, const uint8_t *data, size_t size) {
+	if (gb == NULL || data == NULL || size < 0x150)
+		return -1;
+
+	delete gb->emu;
+	gb->emu = NULL;
+	try {
+		std::unique_ptr<Emulator> emu(new Emulator());
+		emu->initialize(RomImage::fromMemory(data, size));
+		emu->setSpeed(SPEED_UNCAPPED);
+		gb->emu = emu.release();
+		return 0;
+	} catch (...) {
+		logException("jmbgb_load_rom");
+		return -1;
+	}
+}
+
+void jmbgb_run_frame(jmbgb *gb) {
+	if (gb == NULL || gb->emu == NULL)
+		return;
+
+	try {
+		gb->emu->runFrame();
+	} catch (...) {
+		logException("jmbgb_run_frame");
+	}
+}
+
+void jmbgb_set_input(jmbgb *gb, uint8_t buttons) {
+	if (gb == NULL || gb->emu == NULL)
+		return;
+
+	gb->emu->setButtons(buttons);
+}
+
+const uint8_t *jmbgb_get_framebuffer(jmbgb *gb) {
+	if (gb == NULL || gb->emu == NULL)
+		return NULL;
+
+	return gb->emu->getFrameBuffer();
+}
+
+uint64_t jmbgb_get_frame_count(jmbgb *gb) {
+	if (gb == NULL || gb->emu == NULL)
+		return 0;
+
+	return gb->emu->getFrameCount();
+}
+
+size_t jmbgb_save_state(jmbgb *gb, uint8_t *buf, size_t size) {
+	if (gb == NULL || gb->emu == NULL)
+		return 0;
+
+	try {
+		gb->emu->saveState(gb->state);
+	} catch (...) {
+		logException("jmbgb_save_state");
+		return 0;
+	}
+	if (buf != NULL && gb->state.size() <= size)
+		memcpy(buf, &gb->state[0], gb->state.size());
+	return gb->state.size();
+}
+
+int jmbgb_load_state(jmbgb *gb, const uint8_t *buf, size_t size) {
+	if (gb == NULL || gb->emu == NULL || buf == NULL)
+		return -1;
+
+	try {
+		return gb->emu->loadState(buf, size) ? 0 : -1;
+	} catch (...) {
+		logException("jmbgb_load_state");
+		return -1;
+	}
+}
+
+int jmbgb_set_trace(jmbgb *gb, uint32_t num_records, const char *crash_filename) {
+	if (gb == NULL || gb->emu == NULL)
+		return -1;
+
+	try {
+		gb->emu->setTrace(num_records, crash_filename ? crash_filename : "");
+		return 0;
+	} catch (...) {
+		logException("jmbgb_set_trace");
+		return -1;
+	}
+}
+
+int jmbgb_dump_trace(jmbgb *gb, const char *filename) {
+	if (gb == NULL || gb->emu == NULL || filename == NULL)
+		return -1;
+
+	try {
+		return gb->emu->dumpTrace(filename) ? 0 : -1;
+	} catch (...) {
+		logException("jmbgb_dump_trace");
+		return -1;
+	}
+}
+
+jmbgb_vecenv *jmbgb_vecenv_create(const uint8_t *rom, size_t size, int num_envs, int num_threads) {
+	if (rom == NULL || size < 0x150 || num_envs < 1)
+		return NULL;
+
+	try {
+		std::unique_ptr<jmbgb_vecenv> v(new jmbgb_vecenv);
+		v->envs = new VecEnv(RomImage::fromMemory(rom, size), num_envs, num_threads);
+		return v.release();
+	} catch (...) {
+		logException("jmbgb_vecenv_create");
+		return NULL;
+	}
+}
+
+void jmbgb_vecenv_destroy(jmbgb_vecenv *v) {
+	if (v == NULL)
+		return;
+
+	delete v->envs;
+	delete v;
+}
+
+int jmbgb_vecenv_num_envs(jmbgb_vecenv *v) {
+	if (v == NULL)
+		return 0;
+
+	return v->envs->getNumEnvs();
+}
+
+void jmbgb_vecenv_set_ram_addresses(jmbgb_vecenv *v, const uint16_t *addresses, int count) {
+	if (v == NULL)
+		return;
+
+	try {
+		v->envs->setRamAddresses(addresses, addresses != NULL && count > 0 ? count : 0);
+	} catch (...) {
+		logException("jmbgb_vecenv_set_ram_addresses");
+	}
+}
+
+int jmbgb_vecenv_load_state(jmbgb_vecenv *v, int env, const uint8_t *buf, size_t size) {
+	if (v == NULL || env < 0 || env >= v->envs->getNumEnvs() || buf == NULL)
+		return -1;
+
+	try {
+		return v->envs->getEnv(env)->loadState(buf, size) ? 0 : -1;
+	} catch (...) {
+		logException("jmbgb_vecenv_load_state");
+		return -1;
+	}
+}
+
+void jmbgb_vecenv_capture_start(jmbgb_vecenv *v, int env) {
+	if (v == NULL || env < 0 || env >= v->envs->getNumEnvs())
+		return;
+
+	try {
+		v->envs->captureStart(env);
+	} catch (...) {
+		logException("jmbgb_vecenv_capture_start");
+	}
+}
+
+void jmbgb_vecenv_reset(jmbgb_vecenv *v, const uint8_t *mask, uint8_t *observations, uint8_t *ram) {
+	if (v == NULL)
+		return;
+
+	try {
+		v->envs->reset(mask, observations, ram);
+	} catch (...) {
+		logException("jmbgb_vecenv_reset");
+	}
+}
+
+void jmbgb_vecenv_step(jmbgb_vecenv *v, const uint8_t *actions, int frames, uint8_t *observations, uint8_t *ram) {
+	if (v == NULL)
+		return;
+
+	try {
+		v->envs->step(actions, frames, observations, ram);
+	} catch (...) {
+		logException("jmbgb_vecenv_step");
+	}
+}
@@ -0,0 +1,152 @@
+/* jmbgb.h
+ * Author: Jason Blanchard
+ * C interface to the emulation core (libjmbgb), for embedding the emulator
+ * in other programs or driving it from other languages. Nothing here needs
+ * SDL or a window: a handle runs as fast as it's asked to, one frame per
+ * jmbgb_run_frame(), and hands back the frame as shade numbers.
+ *
+ * Handles are independent of each other, but a single handle must not be
+ * used from more than one thread at a time. Functions given a NULL handle
+ * do nothing and return failure. Errors inside the core, including running
+ * out of memory, are logged and returned as failure too.
+ */
+
+#ifndef _JMBGB_H
+#define _JMBGB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Define JMBGB_SHARED when building or using libjmbgb as a shared library
+ * (and JMBGB_BUILD while building it). */
+#if defined(JMBGB_SHARED) && defined(_WIN32)
+#  ifdef JMBGB_BUILD
+#    define JMBGB_API __declspec(dllexport)
+#  else
+#    define JMBGB_API __declspec(dllimport)
+#  endif
+#elif defined(JMBGB_SHARED) && defined(__GNUC__)
+#  define JMBGB_API __attribute__((visibility("default")))
+#else
+#  define JMBGB_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JMBGB_SCREEN_WIDTH 160
+#define JMBGB_SCREEN_HEIGHT 144
+
+/* Buttons for jmbgb_set_input(), or'd together. */
+#define JMBGB_BUTTON_UP     0x01
+#define JMBGB_BUTTON_DOWN   0x02
+#define JMBGB_BUTTON_LEFT   0x04
+#define JMBGB_BUTTON_RIGHT  0x08
+#define JMBGB_BUTTON_A      0x10
+#define JMBGB_BUTTON_B      0x20
+#define JMBGB_BUTTON_START  0x40
+#define JMBGB_BUTTON_SELECT 0x80
+
+typedef struct jmbgb jmbgb;
+
+/* Messages from the core (the cartridge header when a ROM is loaded,
+ * errors) go to standard output. Levels for jmbgb_set_log_level(), each
+ * including the ones before it. */
+#define JMBGB_LOG_NONE    0
+#define JMBGB_LOG_ERROR   1
+#define JMBGB_LOG_WARNING 2
+#define JMBGB_LOG_INFO    3
+
+/* Only write messages up to level, for every handle. */
+JMBGB_API void jmbgb_set_log_level(int level);
+/* Write messages to filename instead, or back to standard output if it's
+ * NULL. Returns 0 on success, -1 if the file can't be created. */
+JMBGB_API int jmbgb_set_log_file(const char *filename);
+
+/* A new handle with no cartridge in it. Returns NULL if out of memory. */
+JMBGB_API jmbgb *jmbgb_create(void);
+JMBGB_API void jmbgb_destroy(jmbgb *gb);
+
+/* Power on with a ROM image. The data is copied, so it can be freed
+ * afterwards. Cartridge RAM is kept in memory only. Loading again starts
+ * over with the new ROM. Returns 0 on success, -1 on failure. */
+JMBGB_API int jmbgb_load_rom(jmbgb *gb, const uint8_t *data, size_t size);
+
+/* Run until the end of the next frame. Does nothing without a ROM. */
+JMBGB_API void jmbgb_run_frame(jmbgb *gb);
+
+/* Buttons held from the next frame on, JMBGB_BUTTON_* or'd together. */
+JMBGB_API void jmbgb_set_input(jmbgb *gb, uint8_t buttons);
+
+/* The last finished frame, JMBGB_SCREEN_WIDTH x JMBGB_SCREEN_HEIGHT bytes
+ * row by row, each a shade from 0 (lightest) to 3 (darkest). The pointer
+ * stays valid until the ROM is reloaded or the handle is destroyed. NULL
+ * without a ROM. */
+JMBGB_API const uint8_t *jmbgb_get_framebuffer(jmbgb *gb);
+
+/* Frames run since power on. */
+JMBGB_API uint64_t jmbgb_get_frame_count(jmbgb *gb);
+
+/* Snapshot the machine into buf. Returns the size of the state; if that's
+ * more than size nothing is written, so call with size 0 to find out how
+ * big a buffer to use. Returns 0 without a ROM. */
+JMBGB_API size_t jmbgb_save_state(jmbgb *gb, uint8_t *buf, size_t size);
+
+/* Restore a snapshot from jmbgb_save_state(). A state for another game, or
+ * a damaged one, is rejected and the machine is left as it was. Returns 0 on
+ * success, -1 on failure. */
+JMBGB_API int jmbgb_load_state(jmbgb *gb, const uint8_t *buf, size_t size);
+
+/* Keep the last num_records instructions run, with the registers before
+ * each, in a ring (0 turns it off). If crash_filename isn't NULL the ring is
+ * written there should the process crash (SIGSEGV, SIGABRT, SIGFPE or
+ * SIGILL). The signal is then passed on to the handler that was installed
+ * before the first such call. Loading a ROM turns it off.
+ * Returns 0 on success, -1 without a ROM. */
+JMBGB_API int jmbgb_set_trace(jmbgb *gb, uint32_t num_records, const char *crash_filename);
+
+/* Write the trace ring to filename, for jmbgb-trace to read. Returns 0 on
+ * success, -1 on failure. */
+JMBGB_API int jmbgb_dump_trace(jmbgb *gb, const char *filename);
+
+/* Vectorized environments: a batch of instances of one game stepped
+ * together, for training agents. Observations are num_envs frames laid out
+ * [num_envs][JMBGB_SCREEN_HEIGHT][JMBGB_SCREEN_WIDTH], drawn straight into
+ * the buffer passed in. RAM reads are [num_envs][count] bytes from the
+ * addresses given. Either can be NULL. Neither buffer is kept after a
+ * reset or step returns, so a new one can be passed each time. */
+typedef struct jmbgb_vecenv jmbgb_vecenv;
+
+/* num_threads <= 0 uses one thread per hardware thread. The ROM data is
+ * copied and shared by every instance. Returns NULL on failure. */
+JMBGB_API jmbgb_vecenv *jmbgb_vecenv_create(const uint8_t *rom, size_t size, int num_envs, int num_threads);
+JMBGB_API void jmbgb_vecenv_destroy(jmbgb_vecenv *v);
+JMBGB_API int jmbgb_vecenv_num_envs(jmbgb_vecenv *v);
+
+/* Addresses to read from every instance after each step and reset. */
+JMBGB_API void jmbgb_vecenv_set_ram_addresses(jmbgb_vecenv *v, const uint16_t *addresses, int count);
+
+/* Restore one instance from a jmbgb_save_state() snapshot. Returns 0 on
+ * success, -1 on failure. */
+JMBGB_API int jmbgb_vecenv_load_state(jmbgb_vecenv *v, int env, const uint8_t *buf, size_t size);
+
+/* Make one instance's current state where resets go back to (power on
+ * until this is called). */
+JMBGB_API void jmbgb_vecenv_capture_start(jmbgb_vecenv *v, int env);
+
+/* Put the instances with a non-zero mask entry (all if mask is NULL) back
+ * at the start, and fill in the observations and RAM of every instance.
+ * The buffers are only used until this returns. */
+JMBGB_API void jmbgb_vecenv_reset(jmbgb_vecenv *v, const uint8_t *mask, uint8_t *observations, uint8_t *ram);
+
+/* Run every instance for frames frames holding actions[env] (JMBGB_BUTTON_*
+ * or'd together), then fill in observations and RAM. The buffers are only
+ * used until this returns. */
+JMBGB_API void jmbgb_vecenv_step(jmbgb_vecenv *v, const uint8_t *actions, int frames, uint8_t *observations, uint8_t *ram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
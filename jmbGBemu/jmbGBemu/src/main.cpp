@@ -4,24 +4,238 @@
 
 #include <iostream>
 #include <fstream>
-#include <SDL.h>
+#include <string>
+#include <cstdlib>
 
 #include "Emulator.h"
+#include "Frontend.h"
+#include "Log.h"
+
+// Parse a palette name or a list of four comma separated RRGGBB colours.
+static bool parsePalette(const std::string &arg, Palette &palette) {
+	if (arg == "green") {
+		palette = PALETTE_GREEN;
+		return true;
+	} else if (arg == "gray" || arg == "grey") {
+		palette = PALETTE_GRAYSCALE;
+		return true;
+	}
+
+	if (arg.size() != 4 * 6 + 3)
+		return false;
+
+	for (int i = 0; i < 4; ++i) {
+		std::string hex = arg.substr(i * 7, 6);
+		if (i < 3 && arg[i * 7 + 6] != ',')
+			return false;
+		if (hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+			return false;
+
+		unsigned long rgb = std::strtoul(hex.c_str(), NULL, 16);
+		palette.rgb[i][0] = (rgb >> 16) & 0xFF;
+		palette.rgb[i][1] = (rgb >> 8) & 0xFF;
+		palette.rgb[i][2] = rgb & 0xFF;
+	}
+
+	return true;
+}
+
+static void printUsage() {
+	std::cout << "Usage: jmbGBemu <rom> [options]\n"
+		<< "  --speed=<n>    run at n times normal speed (e.g. 0.5, 2, 4)\n"
+		<< "  --uncapped     run as fast as possible\n"
+		<< "  --turbo=<n>    speed used while Tab is held (default: uncapped)\n"
+		<< "  --pacing-stats print frame time percentiles and drift\n"
+		<< "  --no-save      keep cartridge RAM in memory, don't read or write a .sav\n"
+		<< "  --rtc-wallclock advance the cartridge clock by the real time since the\n"
+		<< "                 last save (otherwise it only counts emulated time)\n"
+		<< "  --load-state=<f> start from a save state (F5/F8 save and load <rom>.state)\n"
+		<< "  --rewind[=<n>] snapshot every n frames (default 1), hold Backspace to rewind\n"
+		<< "  --record-movie=<f> record the joypad input from power on (not with\n"
+		<< "                 --load-state; loading a state or rewinding stops it)\n"
+		<< "  --play-movie=<f> play back a recorded movie instead of the keyboard\n"
+		<< "  --exit-at-end  quit when the movie finishes\n"
+		<< "  --shm=<name>   publish frames, WRAM and HRAM to shared memory <name>\n"
+		<< "  --shm-slots=<n> frames kept in the shared memory ring (default 8)\n"
+		<< "  --trace[=<n>]  keep the last n instructions run (default 65536), written\n"
+		<< "                 to <rom>.trace with F9 or if the emulator crashes\n"
+		<< "  --profile-opcodes=<f> count opcodes and instruction addresses, written\n"
+		<< "                 to f (CSV, or JSON for .json) on exit\n"
+		<< "  --profile-guest=<f> sample the game's call stack, written to f as\n"
+		<< "                 folded stacks (for flamegraph.pl) on exit\n"
+		<< "  --profile-interval=<n> cycles between samples (default 4096)\n"
+		<< "  --sym=<f>      symbols for --profile-guest (default: <rom>.sym if found)\n"
+		<< "  --heatmap=<name> count reads and writes at every address, written to\n"
+		<< "                 <name>.csv and <name>.png on exit\n"
+		<< "  --log=<f>      write messages to a file instead of the console\n"
+		<< "  --palette=<p>  green, gray, or four RRGGBB colours lightest first\n"
+		<< "                 (e.g. --palette=e0f8d0,88c070,346856,081820)\n";
+}
 
 int main(int argc, char *args[]) {
-    // Handle command line argument issues. Currently, command line will only accept file name
-    if (argc != 2) {
+    // Handle command line argument issues. The first argument is always the ROM filename,
+    // anything after it is an option.
+    if (argc < 2) {
 		std::cout << "Incorrect number of arguments! Include filename of ROM.\n";
-    }
-    else {
-		SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER);
-		Emulator *emu = new Emulator();
-        emu->initialize(std::string(args[1]));
-		emu->run();
-		delete emu;
-		SDL_Quit();
+		printUsage();
+		return 0;
     }
 
+	double speed = 1.0;
+	double turbo = SPEED_UNCAPPED;
+	bool pacing_stats = false;
+	bool battery_saves = true;
+	bool rtc_wallclock = false;
+	std::string load_state;
+	int rewind_interval = 0;
+	std::string record_movie;
+	std::string play_movie;
+	bool exit_at_end = false;
+	std::string shm_name;
+	uint32_t trace_records = 0;
+	std::string profile_opcodes;
+	std::string profile_guest;
+	std::string heatmap;
+	int profile_interval = GUEST_PROFILE_DEFAULT_INTERVAL;
+	std::string sym_filename;
+	int shm_slots = EXPORT_DEFAULT_SLOTS;
+	Palette palette = PALETTE_GREEN;
+	for (int i = 2; i < argc; ++i) {
+		std::string arg(args[i]);
+
+		if (arg.compare(0, 8, "--speed=") == 0) {
+			speed = std::atof(arg.c_str() + 8);
+			if (speed <= 0.0) {
+				std::cout << "Invalid speed: " << arg.substr(8) << "\n";
+				return 0;
+			}
+		} else if (arg == "--uncapped") {
+			speed = SPEED_UNCAPPED;
+		} else if (arg.compare(0, 8, "--turbo=") == 0) {
+			turbo = std::atof(arg.c_str() + 8);
+		} else if (arg == "--pacing-stats") {
+			pacing_stats = true;
+		} else if (arg == "--no-save") {
+			battery_saves = false;
+		} else if (arg == "--rtc-wallclock") {
+			rtc_wallclock = true;
+		} else if (arg.compare(0, 13, "--load-state=") == 0) {
+			load_state = arg.substr(13);
+		} else if (arg.compare(0, 15, "--record-movie=") == 0) {
+			record_movie = arg.substr(15);
+		} else if (arg.compare(0, 13, "--play-movie=") == 0) {
+			play_movie = arg.substr(13);
+		} else if (arg == "--exit-at-end") {
+			exit_at_end = true;
+		} else if (arg.compare(0, 6, "--shm=") == 0) {
+			shm_name = arg.substr(6);
+		} else if (arg.compare(0, 12, "--shm-slots=") == 0) {
+			shm_slots = std::atoi(arg.c_str() + 12);
+			if (shm_slots <= 0) {
+				std::cout << "Invalid number of slots: " << arg.substr(12) << "\n";
+				return 0;
+			}
+		} else if (arg == "--trace") {
+			trace_records = TRACE_DEFAULT_RECORDS;
+		} else if (arg.compare(0, 8, "--trace=") == 0) {
+			int records = std::atoi(arg.c_str() + 8);
+			if (records <= 0) {
+				std::cout << "Invalid number of trace records: " << arg.substr(8) << "\n";
+				return 0;
+			}
+			trace_records = (uint32_t)records;
+		} else if (arg.compare(0, 18, "--profile-opcodes=") == 0) {
+			profile_opcodes = arg.substr(18);
+		} else if (arg.compare(0, 16, "--profile-guest=") == 0) {
+			profile_guest = arg.substr(16);
+		} else if (arg.compare(0, 19, "--profile-interval=") == 0) {
+			profile_interval = std::atoi(arg.c_str() + 19);
+			if (profile_interval <= 0) {
+				std::cout << "Invalid profile interval: " << arg.substr(19) << "\n";
+				return 0;
+			}
+		} else if (arg.compare(0, 10, "--heatmap=") == 0) {
+			heatmap = arg.substr(10);
+		} else if (arg.compare(0, 6, "--sym=") == 0) {
+			sym_filename = arg.substr(6);
+		} else if (arg.compare(0, 6, "--log=") == 0) {
+			if (!emulog::setFile(arg.substr(6)))
+				return 0;
+		} else if (arg == "--rewind") {
+			rewind_interval = 1;
+		} else if (arg.compare(0, 9, "--rewind=") == 0) {
+			rewind_interval = std::atoi(arg.c_str() + 9);
+			if (rewind_interval <= 0) {
+				std::cout << "Invalid rewind interval: " << arg.substr(9) << "\n";
+				return 0;
+			}
+		} else if (arg.compare(0, 10, "--palette=") == 0) {
+			if (!parsePalette(arg.substr(10), palette)) {
+				std::cout << "Invalid palette: " << arg.substr(10) << "\n";
+				return 0;
+			}
+		} else {
+			std::cout << "Unknown option: " << arg << "\n";
+			printUsage();
+			return 0;
+		}
+	}
+
+	Frontend frontend;
+	if (!frontend.open())
+		return 0;
+	frontend.setPalette(palette);
+
+	Emulator *emu = new Emulator();
+	emu->initialize(std::string(args[1]), battery_saves);
+	emu->setSpeed(speed);
+	emu->setTurboSpeed(turbo);
+	emu->setPacingStats(pacing_stats);
+	emu->setRewind(rewind_interval, REWIND_CAPACITY);
+	if (!load_state.empty() && !emu->loadStateFile(load_state)) {
+		delete emu;
+		return 0;
+	}
+	if (rtc_wallclock)
+		emu->catchUpClock();
+	if ((!play_movie.empty() && !emu->playMovie(play_movie)) ||
+		(!record_movie.empty() && !emu->recordMovie(record_movie))) {
+		delete emu;
+		return 0;
+	}
+	emu->setExitAtInputEnd(exit_at_end);
+	if (!shm_name.empty() && !emu->exportFrames(shm_name, shm_slots)) {
+		delete emu;
+		return 0;
+	}
+	if (trace_records > 0)
+		emu->setTrace(trace_records, emu->getTraceFilename());
+	if (!profile_opcodes.empty() && !emu->profileOpcodes(profile_opcodes)) {
+		delete emu;
+		return 0;
+	}
+	if (!profile_guest.empty()) {
+		if (sym_filename.empty()) {
+			// game.gb -> game.sym, as assemblers write them
+			std::string rom(args[1]);
+			size_t dot = rom.rfind('.');
+			size_t slash = rom.find_last_of("/\\");
+			if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+				rom.erase(dot);
+			if (std::ifstream((rom + ".sym").c_str()).is_open())
+				sym_filename = rom + ".sym";
+		}
+		if (!emu->profileGuest(profile_guest, profile_interval, sym_filename)) {
+			delete emu;
+			return 0;
+		}
+	}
+	if (!heatmap.empty() && !emu->recordHeatmap(heatmap)) {
+		delete emu;
+		return 0;
+	}
+	frontend.run(emu);
+	delete emu;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,129 @@
+// BatchJob.cpp
+// Author: Jason Blanchard
+// Implement manifest loading and running of jmbgb-batch jobs.
+
+#include "BatchJob.h"
+#include "Emulator.h"
+#include "RomImage.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+// Split "frame=a.pgm,state=b" into the job's outputs.
+static bool parseOutputs(const std::string &spec, BatchJob &job) {
+	std::stringstream ss(spec);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		if (item.compare(0, 6, "frame=") == 0 && item.size() > 6)
+			job.frame_file = item.substr(6);
+		else if (item.compare(0, 6, "state=") == 0 && item.size() > 6)
+			job.state_file = item.substr(6);
+		else
+			return false;
+	}
+	return true;
+}
+
+bool loadManifest(const std::string &filename, std::vector<BatchJob> &jobs) {
+	std::ifstream file(filename.c_str());
+	if (!file.is_open()) {
+		std::cout << "Couldn't open manifest " << filename << "\n";
+		return false;
+	}
+
+	std::string text;
+	int line = 0;
+	while (std::getline(file, text)) {
+		++line;
+		std::stringstream ss(text);
+		std::string rom, movie, frames, outputs, extra;
+		if (!(ss >> rom) || rom[0] == '#')
+			continue;
+
+		BatchJob job;
+		job.line = line;
+		job.rom = rom;
+		ss >> movie >> frames >> outputs >> extra;
+		job.movie = movie == "-" ? "" : movie;
+		job.frames = std::strtoull(frames.c_str(), NULL, 10);
+		if (movie.empty() || job.frames == 0 || !extra.empty() || !parseOutputs(outputs, job)) {
+			std::cout << filename << ":" << line << ": expected <rom> <movie or -> <frames> [outputs]\n";
+			return false;
+		}
+
+		jobs.push_back(job);
+	}
+
+	return true;
+}
+
+// 64-bit FNV-1a, enough to tell whether two runs ended on the same picture.
+static uint64_t hashFrame(const BYTE *frame) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < 160 * 144; ++i) {
+		hash ^= frame[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool writeFrame(const std::string &filename, const BYTE *frame) {
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	BYTE pixels[160 * 144];
+	for (int i = 0; i < 160 * 144; ++i)
+		pixels[i] = PALETTE_GRAYSCALE.rgb[frame[i]][0];
+
+	file << "P5\n160 144\n255\n";
+	file.write((const char*)pixels, sizeof(pixels));
+	return file.good();
+}
+
+BatchResult runJob(const BatchJob &job) {
+	BatchResult result;
+	result.ok = false;
+	result.frames = 0;
+	result.frame_hash = 0;
+	result.seconds = 0.0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// jobs on the same ROM share one image
+	std::shared_ptr<const RomImage> rom = RomImage::load(job.rom);
+	if (!rom) {
+		result.error = "couldn't open ROM";
+		return result;
+	}
+
+	Emulator emu;
+	emu.initialize(rom);
+	emu.setSpeed(SPEED_UNCAPPED);
+	if (!job.movie.empty() && !emu.playMovie(job.movie)) {
+		result.error = "couldn't load movie";
+		return result;
+	}
+
+	while (emu.getFrameCount() < job.frames && emu.isRunning())
+		emu.runFrame();
+
+	result.frames = emu.getFrameCount();
+	result.frame_hash = hashFrame(emu.getFrameBuffer());
+
+	if (!job.frame_file.empty() && !writeFrame(job.frame_file, emu.getFrameBuffer())) {
+		result.error = "couldn't write " + job.frame_file;
+		return result;
+	}
+	if (!job.state_file.empty() && !emu.saveStateFile(job.state_file)) {
+		result.error = "couldn't write " + job.state_file;
+		return result;
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.ok = true;
+	return result;
+}
@@ -0,0 +1,46 @@
+// BatchJob.h
+// Author: Jason Blanchard
+// Define BatchJob, one run of jmbgb-batch: a ROM played for a number of
+// frames, optionally driven by a movie, with what to keep at the end.
+//
+// A manifest has one job per line, fields separated by whitespace:
+//
+//     <rom> <movie or -> <frames> [outputs]
+//
+// where outputs is a comma separated list of frame=<file.pgm> (the last
+// frame as a grayscale image) and state=<file> (a save state at the end).
+// Blank lines and lines starting with # are skipped.
+
+#ifndef _BATCHJOB_H
+#define _BATCHJOB_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct BatchJob {
+	int line;           // in the manifest, for reporting
+	std::string rom;
+	std::string movie;  // empty for no input
+	uint64_t frames;
+	std::string frame_file;
+	std::string state_file;
+};
+
+struct BatchResult {
+	bool ok;
+	std::string error;
+	uint64_t frames;      // frames actually run
+	uint64_t frame_hash;  // FNV-1a of the last frame
+	double seconds;
+};
+
+// Returns false (after saying why) if the manifest can't be read or has a
+// bad line in it.
+bool loadManifest(const std::string &filename, std::vector<BatchJob> &jobs);
+
+// Run one job start to finish. Only touches its own Emulator, so any
+// number can run at once.
+BatchResult runJob(const BatchJob &job);
+
+#endif
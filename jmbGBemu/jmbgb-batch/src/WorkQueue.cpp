@@ -0,0 +1,72 @@
+// WorkQueue.cpp
+// Author: Jason Blanchard
+// Implement WorkQueue class, a work-stealing thread pool.
+
+#include "WorkQueue.h"
+
+#include <thread>
+
+WorkQueue::WorkQueue(int num_workers) {
+	if (num_workers <= 0)
+		num_workers = (int)std::thread::hardware_concurrency();
+	if (num_workers <= 0)
+		num_workers = 1;
+
+	for (int i = 0; i < num_workers; ++i)
+		workers_.push_back(new Worker());
+}
+
+WorkQueue::~WorkQueue() {
+	for (size_t i = 0; i < workers_.size(); ++i)
+		delete workers_[i];
+}
+
+int WorkQueue::getNumWorkers() {
+	return (int)workers_.size();
+}
+
+void WorkQueue::run(const std::vector<size_t> &order, std::function<void(size_t, int)> job) {
+	for (size_t i = 0; i < order.size(); ++i)
+		workers_[i % workers_.size()]->jobs.push_back(order[i]);
+
+	// the calling thread is worker 0
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < workers_.size(); ++i)
+		threads.push_back(std::thread(&WorkQueue::work, this, (int)i, std::cref(job)));
+	work(0, job);
+
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+// Own jobs first, then steal. Jobs never add more jobs, so once every deque
+// has been found empty there's nothing left to do.
+bool WorkQueue::takeJob(int worker, size_t &job) {
+	Worker *own = workers_[worker];
+	{
+		std::lock_guard<std::mutex> lock(own->lock);
+		if (!own->jobs.empty()) {
+			job = own->jobs.front();
+			own->jobs.pop_front();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < workers_.size(); ++i) {
+		Worker *victim = workers_[(worker + i) % workers_.size()];
+		std::lock_guard<std::mutex> lock(victim->lock);
+		if (!victim->jobs.empty()) {
+			job = victim->jobs.back();
+			victim->jobs.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkQueue::work(int worker, const std::function<void(size_t, int)> &job) {
+	size_t i;
+	while (takeJob(worker, i))
+		job(i, worker);
+}
@@ -0,0 +1,46 @@
+// WorkQueue.h
+// Author: Jason Blanchard
+// Define WorkQueue class, a work-stealing thread pool for running a fixed
+// list of independent jobs. Jobs are dealt out to the workers up front; each
+// worker runs its own from the front of its deque, and one that runs dry
+// steals from the back of someone else's. Workers only touch each other's
+// deques when stealing, so they hardly ever contend.
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <cstddef>
+
+class WorkQueue {
+public:
+	// num_workers <= 0 uses one per hardware thread
+	explicit WorkQueue(int num_workers);
+	~WorkQueue();
+
+	int getNumWorkers();
+
+	// Run job(i, worker) once for every i in order (dealt round robin, so
+	// put the longest jobs first) and wait for all of them to finish. job
+	// is called from several threads at once.
+	void run(const std::vector<size_t> &order, std::function<void(size_t, int)> job);
+
+private:
+	// one per worker, allocated separately and padded out so workers don't
+	// slow each other down through a shared cache line
+	struct Worker {
+		std::mutex lock;
+		std::deque<size_t> jobs;
+		char padding[64];
+	};
+
+	std::vector<Worker*> workers_;
+
+	bool takeJob(int worker, size_t &job);
+	void work(int worker, const std::function<void(size_t, int)> &job);
+};
+
+#endif
@@ -0,0 +1,97 @@
+// main.cpp
+// Author: Jason Blanchard
+// Entry point for jmbgb-batch, which runs a manifest of emulator jobs across
+// every core and reports how each one ended. See BatchJob.h for the manifest
+// format.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "BatchJob.h"
+#include "WorkQueue.h"
+#include "Log.h"
+
+static void printUsage() {
+	std::cout << "Usage: jmbgb-batch <manifest> [options]\n"
+		<< "  --threads=<n>  worker threads (default: one per hardware thread)\n"
+		<< "  --verbose      keep the emulators' own messages\n";
+}
+
+int main(int argc, char *args[]) {
+	if (argc < 2) {
+		printUsage();
+		return 2;
+	}
+
+	int threads = 0;
+	bool verbose = false;
+	for (int i = 2; i < argc; ++i) {
+		std::string arg(args[i]);
+
+		if (arg.compare(0, 10, "--threads=") == 0) {
+			threads = std::atoi(arg.c_str() + 10);
+		} else if (arg == "--verbose") {
+			verbose = true;
+		} else {
+			std::cout << "Unknown option: " << arg << "\n";
+			printUsage();
+			return 2;
+		}
+	}
+
+	std::vector<BatchJob> jobs;
+	if (!loadManifest(args[1], jobs))
+		return 2;
+
+	std::vector<size_t> order(jobs.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	// longest first, so a long job isn't the last one started
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return jobs[a].frames > jobs[b].frames;
+	});
+
+	WorkQueue queue(threads);
+	std::cout << "Running " << jobs.size() << " jobs on " << queue.getNumWorkers() << " threads\n";
+	std::cout.flush();
+
+	// the emulators log from every thread at once, which would only be noise
+	// here. Results are printed with stdio afterwards.
+	if (!verbose)
+		emulog::setLevel(EMULOG_LEVEL_NONE);
+
+	// each job only writes its own slot
+	std::vector<BatchResult> results(jobs.size());
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	queue.run(order, [&](size_t i, int) {
+		results[i] = runJob(jobs[i]);
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// let --verbose output finish before the results
+	emulog::flush();
+
+	int failed = 0;
+	uint64_t total_frames = 0;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		const BatchResult &r = results[i];
+		if (r.ok) {
+			std::printf("line %d: ok %s %llu frames %016llx %.2fs\n", jobs[i].line, jobs[i].rom.c_str(),
+				(unsigned long long)r.frames, (unsigned long long)r.frame_hash, r.seconds);
+		} else {
+			std::printf("line %d: FAILED %s: %s\n", jobs[i].line, jobs[i].rom.c_str(), r.error.c_str());
+			++failed;
+		}
+		total_frames += r.frames;
+	}
+
+	std::printf("%d of %d jobs failed, %llu frames in %.2fs (%.0f frames/s)\n", failed, (int)jobs.size(),
+		(unsigned long long)total_frames, seconds, seconds > 0.0 ? total_frames / seconds : 0.0);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+// ControlProtocol.h
+// Author: Jason Blanchard
+// The binary protocol jmbgb-server speaks over its Unix domain socket. Each
+// connection gets its own emulator, which lives as long as the connection.
+//
+// Everything is little endian. A request is an 8 byte header followed by
+// its payload:
+//
+//     op (8 bits), 3 bytes reserved (0), payload length (32 bits)
+//
+// and every request gets exactly one response, in order:
+//
+//     op (8 bits, echoed), status (8 bits), 2 bytes reserved (0),
+//     payload length (32 bits), payload
+//
+// Requests can be pipelined: send as many as you like without waiting. The
+// server works through everything it has received before writing the
+// responses back together.
+
+#ifndef _CONTROLPROTOCOL_H
+#define _CONTROLPROTOCOL_H
+
+#include <cstdint>
+
+const int CONTROL_HEADER_SIZE = 8;
+
+// Largest payload accepted; enough for any ROM.
+const uint32_t CONTROL_MAX_PAYLOAD = 16 * 1024 * 1024;
+
+enum ControlOp {
+	// ROM data -> nothing. Powers on a fresh emulator with it.
+	CONTROL_LOAD_ROM = 0x01,
+	// ROM filename -> nothing. Like LOAD_ROM, but connections running the
+	// same file share one copy of it.
+	CONTROL_LOAD_ROM_FILE = 0x02,
+	// frames (32 bits) -> frame count since power on (64 bits)
+	CONTROL_STEP = 0x03,
+	// buttons (8 bits, bit n for Button n) -> nothing. Held from the next
+	// frame on.
+	CONTROL_SET_INPUT = 0x04,
+	// address (16 bits), length (16 bits) -> that many bytes, read without
+	// side effects
+	CONTROL_READ_MEMORY = 0x05,
+	// address (16 bits), bytes -> nothing. Written as the CPU would.
+	CONTROL_WRITE_MEMORY = 0x06,
+	// nothing -> 160x144 shades (0-3), row by row
+	CONTROL_GET_FRAME = 0x07,
+	// nothing -> save state
+	CONTROL_SAVE_STATE = 0x08,
+	// save state -> nothing
+	CONTROL_LOAD_STATE = 0x09
+};
+
+enum ControlStatus {
+	CONTROL_OK = 0,
+	CONTROL_BAD_REQUEST = 1, // unknown op or malformed payload
+	CONTROL_NO_ROM = 2,      // needs a ROM loaded first
+	CONTROL_FAILED = 3       // well formed, but didn't work (bad ROM, state...)
+};
+
+#endif
@@ -0,0 +1,328 @@
+// ControlServer.cpp
+// Author: Jason Blanchard
+// Implement ControlServer and ControlSession, the jmbgb-server socket loop
+// and request handling.
+
+#include "ControlServer.h"
+#include "ControlProtocol.h"
+#include "Emulator.h"
+#include "RomImage.h"
+
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#define poll WSAPoll
+#define SHUT_RDWR SD_BOTH
+const int SEND_FLAGS = 0;
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+const SocketHandle INVALID_SOCKET = -1;
+#define closesocket close
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+#endif
+
+// How often the accept loop checks whether it's been stopped, in ms.
+const int ACCEPT_POLL_MS = 200;
+
+// Bytes asked for per recv(). Pipelined requests arrive together and are
+// all handled before anything is written back.
+const size_t RECV_CHUNK = 64 * 1024;
+
+static uint16_t read16(const BYTE *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read32(const BYTE *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write32(BYTE *p, uint32_t val) {
+	for (int i = 0; i < 4; ++i)
+		p[i] = (BYTE)(val >> (i * 8));
+}
+
+// Remove a socket file left at path. Returns false, leaving it alone, if
+// something other than a socket is there.
+static bool removeSocketFile(const std::string &path) {
+#ifdef _WIN32
+	// Unix sockets show up on Windows as reparse points
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES)
+		return true;
+	if (!(attributes & FILE_ATTRIBUTE_REPARSE_POINT))
+		return false;
+	DeleteFileA(path.c_str());
+#else
+	struct stat st;
+	if (lstat(path.c_str(), &st) != 0)
+		return true;
+	if (!S_ISSOCK(st.st_mode))
+		return false;
+	unlink(path.c_str());
+#endif
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// ControlServer
+
+ControlServer::ControlServer() {
+	listen_socket_ = INVALID_SOCKET;
+	running_ = false;
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+}
+
+ControlServer::~ControlServer() {
+	if (listen_socket_ != INVALID_SOCKET)
+		closesocket(listen_socket_);
+	if (!path_.empty())
+		removeSocketFile(path_);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+bool ControlServer::listen(const std::string &path) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		std::cout << "Socket path is too long: " << path << "\n";
+		return false;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	listen_socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_socket_ == INVALID_SOCKET) {
+		std::cout << "Couldn't create a socket.\n";
+		return false;
+	}
+
+	// a socket file left behind by a server that didn't shut down cleanly
+	// would stop us binding. Anything else at the path is the user's.
+	if (!removeSocketFile(path)) {
+		std::cout << path << " exists and isn't a socket, not replacing it.\n";
+		closesocket(listen_socket_);
+		listen_socket_ = INVALID_SOCKET;
+		return false;
+	}
+	if (bind(listen_socket_, (sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(listen_socket_, 64) != 0) {
+		std::cout << "Couldn't listen on " << path << "\n";
+		closesocket(listen_socket_);
+		listen_socket_ = INVALID_SOCKET;
+		return false;
+	}
+
+	path_ = path;
+	running_ = true;
+	return true;
+}
+
+void ControlServer::run() {
+	while (running_) {
+		pollfd pfd;
+		pfd.fd = listen_socket_;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0)
+			continue;
+
+		SocketHandle client = accept(listen_socket_, NULL, NULL);
+		if (client == INVALID_SOCKET)
+			continue;
+
+		std::lock_guard<std::mutex> lock(lock_);
+		clients_.push_back(client);
+		std::thread(&ControlServer::serveClient, this, client).detach();
+	}
+
+	// cut off whoever is still connected and wait for them to finish up
+	std::unique_lock<std::mutex> lock(lock_);
+	for (size_t i = 0; i < clients_.size(); ++i)
+		shutdown(clients_[i], SHUT_RDWR);
+	while (!clients_.empty())
+		clients_done_.wait(lock);
+}
+
+void ControlServer::stop() {
+	running_ = false;
+}
+
+static bool sendAll(SocketHandle s, const BYTE *data, size_t size) {
+	while (size > 0) {
+		int sent = send(s, (const char *)data, (int)std::min(size, (size_t)1 << 30), SEND_FLAGS);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+void ControlServer::serveClient(SocketHandle client) {
+	ControlSession session;
+	std::vector<BYTE> in;
+	std::vector<BYTE> out;
+	size_t pending = 0; // bytes of in holding requests not handled yet
+
+	for (;;) {
+		if (in.size() < pending + RECV_CHUNK)
+			in.resize(pending + RECV_CHUNK);
+		int got = recv(client, (char *)&in[pending], (int)RECV_CHUNK, 0);
+		if (got <= 0)
+			break;
+		pending += got;
+
+		out.clear();
+		long used = session.handleRequests(&in[0], pending, out);
+		if (used < 0 || !sendAll(client, out.empty() ? NULL : &out[0], out.size()))
+			break;
+
+		// keep the start of an unfinished request for next time
+		memmove(&in[0], &in[used], pending - used);
+		pending -= used;
+	}
+
+	// out of clients_ before it's closed, so run() can't shut down a socket
+	// that has been closed, or one the number has since been reused for
+	std::lock_guard<std::mutex> lock(lock_);
+	clients_.erase(std::find(clients_.begin(), clients_.end(), client));
+	closesocket(client);
+	clients_done_.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// ControlSession
+
+ControlSession::ControlSession() {
+	emu_ = NULL;
+}
+
+ControlSession::~ControlSession() {
+	delete emu_;
+}
+
+long ControlSession::handleRequests(const BYTE *data, size_t size, std::vector<BYTE> &out) {
+	size_t pos = 0;
+	while (size - pos >= (size_t)CONTROL_HEADER_SIZE) {
+		BYTE op = data[pos];
+		uint32_t length = read32(&data[pos + 4]);
+		if (length > CONTROL_MAX_PAYLOAD)
+			return -1;
+		if (size - pos - CONTROL_HEADER_SIZE < length)
+			break;
+
+		// the response header is filled in once the payload is known
+		size_t start = out.size();
+		out.resize(start + CONTROL_HEADER_SIZE, 0);
+		BYTE status = handle(op, &data[pos + CONTROL_HEADER_SIZE], length, out);
+
+		out[start] = op;
+		out[start + 1] = status;
+		write32(&out[start + 4], (uint32_t)(out.size() - start - CONTROL_HEADER_SIZE));
+
+		pos += CONTROL_HEADER_SIZE + length;
+	}
+
+	return (long)pos;
+}
+
+BYTE ControlSession::loadRom(const BYTE *payload, uint32_t size, bool from_file) {
+	std::shared_ptr<const RomImage> rom;
+	if (from_file)
+		rom = RomImage::load(std::string((const char *)payload, size));
+	else if (size >= 0x150)
+		rom = RomImage::fromMemory(payload, size);
+	if (!rom)
+		return CONTROL_FAILED;
+
+	delete emu_;
+	emu_ = new Emulator();
+	emu_->initialize(rom);
+	emu_->setSpeed(SPEED_UNCAPPED);
+	return CONTROL_OK;
+}
+
+// Handle one request, appending its response payload to out.
+BYTE ControlSession::handle(BYTE op, const BYTE *payload, uint32_t size, std::vector<BYTE> &out) {
+	if (op == CONTROL_LOAD_ROM || op == CONTROL_LOAD_ROM_FILE)
+		return loadRom(payload, size, op == CONTROL_LOAD_ROM_FILE);
+	if (op < CONTROL_STEP || op > CONTROL_LOAD_STATE)
+		return CONTROL_BAD_REQUEST;
+	if (emu_ == NULL)
+		return CONTROL_NO_ROM;
+
+	switch (op) {
+	case CONTROL_STEP: {
+		if (size != 4)
+			return CONTROL_BAD_REQUEST;
+		uint32_t frames = read32(payload);
+		for (uint32_t i = 0; i < frames && emu_->isRunning(); ++i)
+			emu_->runFrame();
+
+		uint64_t count = emu_->getFrameCount();
+		for (int i = 0; i < 8; ++i)
+			out.push_back((BYTE)(count >> (i * 8)));
+		return CONTROL_OK;
+	}
+
+	case CONTROL_SET_INPUT:
+		if (size != 1)
+			return CONTROL_BAD_REQUEST;
+		emu_->setButtons(payload[0]);
+		return CONTROL_OK;
+
+	case CONTROL_READ_MEMORY: {
+		if (size != 4)
+			return CONTROL_BAD_REQUEST;
+		WORD address = read16(payload);
+		WORD length = read16(payload + 2);
+		for (WORD i = 0; i < length; ++i)
+			out.push_back(emu_->peekMemory((WORD)(address + i)));
+		return CONTROL_OK;
+	}
+
+	case CONTROL_WRITE_MEMORY: {
+		if (size < 2)
+			return CONTROL_BAD_REQUEST;
+		WORD address = read16(payload);
+		for (uint32_t i = 2; i < size; ++i)
+			emu_->pokeMemory((WORD)(address + i - 2), payload[i]);
+		return CONTROL_OK;
+	}
+
+	case CONTROL_GET_FRAME: {
+		const BYTE *frame = emu_->getFrameBuffer();
+		out.insert(out.end(), frame, frame + 160 * 144);
+		return CONTROL_OK;
+	}
+
+	case CONTROL_SAVE_STATE:
+		emu_->saveState(state_);
+		out.insert(out.end(), state_.begin(), state_.end());
+		return CONTROL_OK;
+
+	case CONTROL_LOAD_STATE:
+		return emu_->loadState(payload, size) ? CONTROL_OK : CONTROL_FAILED;
+	}
+
+	return CONTROL_BAD_REQUEST;
+}
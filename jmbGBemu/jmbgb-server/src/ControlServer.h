@@ -0,0 +1,73 @@
+// ControlServer.h
+// Author: Jason Blanchard
+// Define ControlServer class, which listens on a Unix domain socket and runs
+// one emulator per connection, driven by the requests in ControlProtocol.h.
+// Each connection is served by its own thread, so a pool of clients keeps a
+// pool of long-lived emulators busy without starting a process per job.
+
+#ifndef _CONTROLSERVER_H
+#define _CONTROLSERVER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "definitions.h"
+
+#ifdef _WIN32
+typedef uintptr_t SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+class ControlServer {
+public:
+	ControlServer();
+	~ControlServer();
+
+	// Bind the socket at path, replacing a stale socket file left there.
+	bool listen(const std::string &path);
+
+	// Accept and serve connections until stop() is called.
+	void run();
+	// Safe to call from another thread or a signal handler.
+	void stop();
+
+private:
+	std::string path_;
+	SocketHandle listen_socket_;
+	std::atomic<bool> running_;
+
+	// connections still being served, so stopping can cut them off and
+	// wait for their threads
+	std::mutex lock_;
+	std::condition_variable clients_done_;
+	std::vector<SocketHandle> clients_;
+
+	void serveClient(SocketHandle client);
+};
+
+// One connection's emulator and the requests it's working through.
+class ControlSession {
+public:
+	ControlSession();
+	~ControlSession();
+
+	// Handle every complete request in data, appending the responses to
+	// out. Returns how many bytes were used; the rest is an unfinished
+	// request to come back to once more has arrived. Returns -1 if the
+	// connection should be dropped.
+	long handleRequests(const BYTE *data, size_t size, std::vector<BYTE> &out);
+
+private:
+	Emulator *emu_;
+	std::vector<BYTE> state_; // scratch space for SAVE_STATE
+
+	BYTE handle(BYTE op, const BYTE *payload, uint32_t size, std::vector<BYTE> &out);
+	BYTE loadRom(const BYTE *payload, uint32_t size, bool from_file);
+};
+
+#endif
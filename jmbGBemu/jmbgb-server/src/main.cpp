@@ -0,0 +1,42 @@
+// main.cpp
+// Author: Jason Blanchard
+// Entry point for jmbgb-server, which runs headless emulators for clients
+// on a local Unix domain socket. See ControlProtocol.h for the protocol.
+
+#include <iostream>
+#include <string>
+#include <csignal>
+
+#include "ControlServer.h"
+
+static ControlServer *server = NULL;
+
+static void handleSignal(int) {
+	if (server != NULL)
+		server->stop();
+}
+
+int main(int argc, char *args[]) {
+	if (argc != 2) {
+		std::cout << "Usage: jmbgb-server <socket path>\n";
+		return 2;
+	}
+
+	ControlServer control;
+	if (!control.listen(args[1]))
+		return 1;
+
+	server = &control;
+	std::signal(SIGINT, handleSignal);
+	std::signal(SIGTERM, handleSignal);
+#ifdef SIGPIPE
+	// a client going away mid-response is dealt with where send() fails
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+	std::cout << "Listening on " << args[1] << "\n";
+	control.run();
+	server = NULL;
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+# client.py
+# Author: Jason Blanchard
+# Minimal client for jmbgb-server, and a check that a running server speaks
+# the protocol in ControlProtocol.h:
+#
+#     jmbgb-server /tmp/jmbgb.sock &
+#     python3 client.py /tmp/jmbgb.sock game.gb
+#
+# Prints each check as it goes and exits with 1 if any of them fail. Client
+# can also be imported and used on its own.
+
+import socket
+import struct
+import sys
+
+LOAD_ROM = 0x01
+LOAD_ROM_FILE = 0x02
+STEP = 0x03
+SET_INPUT = 0x04
+READ_MEMORY = 0x05
+WRITE_MEMORY = 0x06
+GET_FRAME = 0x07
+SAVE_STATE = 0x08
+LOAD_STATE = 0x09
+
+OK = 0
+BAD_REQUEST = 1
+NO_ROM = 2
+FAILED = 3
+
+
+def request(op, payload=b''):
+    return struct.pack('<BxxxI', op, len(payload)) + payload
+
+
+class Client:
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.file = self.sock.makefile('rb')
+
+    def close(self):
+        self.file.close()
+        self.sock.close()
+
+    def send(self, *requests):
+        """Send requests without waiting for their responses."""
+        self.sock.sendall(b''.join(requests))
+
+    def receive(self):
+        """The next response: (op, status, payload)."""
+        header = self.file.read(8)
+        if len(header) < 8:
+            raise EOFError('server closed the connection')
+        op, status, length = struct.unpack('<BBxxI', header)
+        return op, status, self.file.read(length)
+
+    def call(self, op, payload=b''):
+        self.send(request(op, payload))
+        return self.receive()
+
+    def load_rom(self, data):
+        return self.call(LOAD_ROM, data)[1]
+
+    def step(self, frames):
+        op, status, payload = self.call(STEP, struct.pack('<I', frames))
+        return struct.unpack('<Q', payload)[0] if status == OK else None
+
+    def set_input(self, buttons):
+        return self.call(SET_INPUT, bytes([buttons]))[1]
+
+    def read_memory(self, address, length):
+        op, status, payload = self.call(READ_MEMORY, struct.pack('<HH', address, length))
+        return payload if status == OK else None
+
+    def write_memory(self, address, data):
+        return self.call(WRITE_MEMORY, struct.pack('<H', address) + data)[1]
+
+    def get_frame(self):
+        return self.call(GET_FRAME)[2]
+
+    def save_state(self):
+        return self.call(SAVE_STATE)[2]
+
+    def load_state(self, state):
+        return self.call(LOAD_STATE, state)[1]
+
+
+def main(args):
+    if len(args) != 3:
+        print('Usage: client.py <socket path> <rom>')
+        return 2
+
+    failures = []
+
+    def check(name, passed):
+        print('%-40s %s' % (name, 'ok' if passed else 'FAILED'))
+        if not passed:
+            failures.append(name)
+
+    with open(args[2], 'rb') as f:
+        rom = f.read()
+
+    c = Client(args[1])
+    check('step before a ROM is loaded', c.call(STEP, struct.pack('<I', 1))[1] == NO_ROM)
+    check('load ROM', c.load_rom(rom) == OK)
+    check('step counts frames', c.step(10) == 10)
+
+    check('write memory', c.write_memory(0xC000, b'\xde\xad\xbe\xef') == OK)
+    check('read memory back', c.read_memory(0xC000, 4) == b'\xde\xad\xbe\xef')
+    check('read memory from ROM', c.read_memory(0x0134, 16) == rom[0x0134:0x0144])
+
+    op, status, _ = c.call(0x55)
+    check('unknown op is a bad request', op == 0x55 and status == BAD_REQUEST)
+    check('malformed payload is a bad request', c.call(STEP, b'\x01')[1] == BAD_REQUEST)
+    check('connection survives bad requests', c.step(1) == 11)
+
+    # everything in one send, answered in order
+    c.send(request(SET_INPUT, b'\x00'),
+           request(WRITE_MEMORY, struct.pack('<H', 0xC010) + b'\x42'),
+           request(0x77),
+           request(READ_MEMORY, struct.pack('<HH', 0xC010, 1)),
+           request(STEP, struct.pack('<I', 5)))
+    responses = [c.receive() for _ in range(5)]
+    check('pipelined responses come back in order',
+          [r[0] for r in responses] == [SET_INPUT, WRITE_MEMORY, 0x77, READ_MEMORY, STEP])
+    check('pipelined statuses',
+          [r[1] for r in responses] == [OK, OK, BAD_REQUEST, OK, OK])
+    check('pipelined read sees the write', responses[3][2] == b'\x42')
+    check('pipelined step', struct.unpack('<Q', responses[4][2])[0] == 16)
+
+    state = c.save_state()
+    c.step(30)
+    frame = c.get_frame()
+    check('frame is 160x144', len(frame) == 160 * 144)
+    check('load state', c.load_state(state) == OK)
+    c.step(30)
+    check('replay from a state is the same', c.get_frame() == frame)
+    check('damaged state is refused', c.load_state(state[:100]) == FAILED)
+    c.close()
+
+    print('%d checks failed' % len(failures) if failures else 'all checks passed')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,163 @@
+// main.cpp
+// Author: Jason Blanchard
+// Entry point for jmbgb-trace, which prints the instruction traces written
+// by TraceBuffer (F9, --trace, jmbgb_dump_trace()) as text, or compares two
+// of them and shows where they first go different.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+
+#include "TraceBuffer.h"
+
+static void printUsage() {
+	std::cout << "Usage: jmbgb-trace <trace> [options]\n"
+		<< "       jmbgb-trace <trace> <other trace> [options]\n"
+		<< "  --last=<n>     only print the last n instructions\n"
+		<< "  --context=<n>  instructions shown around a difference (default 10)\n"
+		<< "With two traces, the instructions both cover (by cycle) are compared\n"
+		<< "and the first difference is shown. Exits with 1 if there is one.\n";
+}
+
+static bool loadTrace(const std::string &filename, std::vector<TraceRecord> &records) {
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Couldn't open " << filename << "\n";
+		return false;
+	}
+
+	TraceHeader header;
+	if (!file.read((char *)&header, sizeof(header)) || header.magic != TRACE_MAGIC) {
+		std::cout << filename << " isn't a trace.\n";
+		return false;
+	}
+	if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+		std::cout << "Trace version " << header.version << " isn't supported (expected "
+			<< TRACE_VERSION << ").\n";
+		return false;
+	}
+
+	// check the count against what's really there before making room for it
+	std::streamoff start = file.tellg();
+	file.seekg(0, std::ios::end);
+	uint64_t available = (uint64_t)(file.tellg() - start) / sizeof(TraceRecord);
+	file.seekg(start);
+	if (header.count > available) {
+		std::cout << filename << " is cut short (" << available << " of " << header.count
+			<< " instructions).\n";
+		return false;
+	}
+
+	records.resize((size_t)header.count);
+	if (header.count > 0 && !file.read((char *)&records[0], (std::streamsize)(header.count * sizeof(TraceRecord)))) {
+		std::cout << filename << " couldn't be read.\n";
+		return false;
+	}
+	return true;
+}
+
+static void printRecord(const char *prefix, const TraceRecord &r) {
+	// MBC5 has banks up to 1FF
+	char bank[8];
+	if (r.bank == 0xFFFF)
+		std::snprintf(bank, sizeof(bank), "---");
+	else
+		std::snprintf(bank, sizeof(bank), "%03X", r.bank);
+
+	std::printf("%s%12llu  %s:%04X  %02X  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X%s\n", prefix,
+		(unsigned long long)r.cycle, bank, r.pc, r.opcode, r.af, r.bc, r.de, r.hl, r.sp,
+		(r.flags & TRACE_FLAG_IME) ? "  IME" : "");
+}
+
+static bool sameRecord(const TraceRecord &a, const TraceRecord &b) {
+	return a.cycle == b.cycle && a.pc == b.pc && a.bank == b.bank && a.opcode == b.opcode &&
+		a.flags == b.flags && a.af == b.af && a.bc == b.bc && a.de == b.de && a.hl == b.hl && a.sp == b.sp;
+}
+
+// Compare the part of two traces that covers the same cycles. Returns
+// whether they matched.
+static bool diffTraces(const std::vector<TraceRecord> &a, const std::vector<TraceRecord> &b, size_t context) {
+	if (a.empty() || b.empty()) {
+		std::cout << "Nothing to compare, a trace is empty.\n";
+		return a.empty() && b.empty();
+	}
+
+	// start where both have records, and stop at the end of the shorter
+	uint64_t start = a[0].cycle > b[0].cycle ? a[0].cycle : b[0].cycle;
+	size_t i = 0, j = 0;
+	while (i < a.size() && a[i].cycle < start)
+		++i;
+	while (j < b.size() && b[j].cycle < start)
+		++j;
+
+	if (i == a.size() || j == b.size()) {
+		std::cout << "The traces don't cover any of the same cycles.\n";
+		return false;
+	}
+
+	size_t first = i;
+	while (i < a.size() && j < b.size() && sameRecord(a[i], b[j])) {
+		++i;
+		++j;
+	}
+	if (i == a.size() || j == b.size()) {
+		std::printf("Traces match over %llu instructions (cycles %llu-%llu).\n",
+			(unsigned long long)(i - first), (unsigned long long)start,
+			(unsigned long long)a[i - 1].cycle);
+		return true;
+	}
+
+	std::printf("Traces differ after %llu matching instructions:\n\n", (unsigned long long)(i - first));
+	size_t from = i - first > context ? i - context : first;
+	for (size_t k = from; k < i; ++k)
+		printRecord("  ", a[k]);
+	for (size_t k = i; k < a.size() && k < i + context; ++k)
+		printRecord("- ", a[k]);
+	for (size_t k = j; k < b.size() && k < j + context; ++k)
+		printRecord("+ ", b[k]);
+	return false;
+}
+
+int main(int argc, char *args[]) {
+	std::vector<std::string> files;
+	size_t last = 0;
+	size_t context = 10;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(args[i]);
+
+		if (arg.compare(0, 7, "--last=") == 0) {
+			last = (size_t)std::atol(arg.c_str() + 7);
+		} else if (arg.compare(0, 10, "--context=") == 0) {
+			context = (size_t)std::atol(arg.c_str() + 10);
+		} else if (arg.compare(0, 2, "--") == 0) {
+			std::cout << "Unknown option: " << arg << "\n";
+			printUsage();
+			return 2;
+		} else {
+			files.push_back(arg);
+		}
+	}
+	if (files.empty() || files.size() > 2) {
+		printUsage();
+		return 2;
+	}
+
+	std::vector<TraceRecord> a;
+	if (!loadTrace(files[0], a))
+		return 2;
+
+	if (files.size() == 2) {
+		std::vector<TraceRecord> b;
+		if (!loadTrace(files[1], b))
+			return 2;
+		return diffTraces(a, b, context) ? 0 : 1;
+	}
+
+	size_t from = last > 0 && last < a.size() ? a.size() - last : 0;
+	for (size_t i = from; i < a.size(); ++i)
+		printRecord("", a[i]);
+	return 0;
+}